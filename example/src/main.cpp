@@ -1,35 +1,39 @@
 #include "http-server/http-server.hpp"
+#include "http-server/static-files.hpp"
 #include "http-server/log.hpp"
 #include "http-server/db/sqlite.hpp"
 #include "http-server/ulid.hpp"
 #include "http-server/db/tarantool/client.hpp"
 
 struct App {
-  http::db::Sqlite db{ { .db_name = "gallery.db" } };
+  http::db::Sqlite db{ {
+      .db_name       = "gallery.db",
+      .min_pool_size = 4,
+      .query_cache   = { .max_entries = 1024 },
+  } };
 } g_app;
 
 //-----------------------------------------------------------------------
 
 struct ExampleHandler : public http::HttpRequestHandler {
   static inline http::HttpMethod method = http::HttpMethod::GET;
-  static inline const char*      path   = "/api/example";
+  using Route                           = http::Route<"/api/example">;
 
   ~ExampleHandler() override {
     http::g_log->debug("~ExampleHandler");
   }
 
   HandleResult handle() override {
+    cancellation.set_timeout(std::chrono::seconds{ 2 });
     return g_app.db
-        .with_connection(
-            [](sqlite::database& db) {
+        .with_cached_connection(
+            http::db::cached_query("select count(*) from tests where age > ? ;", { "tests" }, 18),
+            [](sqlite::database_binder& rows) {
               int result;
-              db << "select count(*) from tests where age > ? ;"
-                 << 18 >>
-                  [&](int count) {
-                    result = count;
-                  };
+              rows >> result;
               return result;
-            })
+            },
+            cancellation)
         .then([](int count) {
           http::HttpResponse response{};
           response.status(http::HttpStatusCode::OK)
@@ -44,13 +48,14 @@ struct ExampleHandler : public http::HttpRequestHandler {
 
 struct FillHandler : public http::HttpRequestHandler {
   static inline http::HttpMethod method = http::HttpMethod::GET;
-  static inline const char*      path   = "/api/fill";
+  using Route                           = http::Route<"/api/fill">;
 
   ~FillHandler() override = default;
 
   HandleResult handle() override {
     return g_app.db
-        .with_connection(
+        .with_write_connection(
+            { "tests" },
             [](sqlite::database& db) {
               db << "create table if not exists tests ("
                     "   _id integer primary key autoincrement not null,"
@@ -78,21 +83,93 @@ struct FillHandler : public http::HttpRequestHandler {
 
 //-----------------------------------------------------------------------
 
+struct DeleteTestHandler : public http::HttpRequestHandler {
+  static inline http::HttpMethod method = http::HttpMethod::DELETE;
+  using Route                           = http::Route<"/api/tests/{int}">;
+
+  Route::Params params{};
+
+  ~DeleteTestHandler() override = default;
+
+  HandleResult handle() override {
+    return g_app.db
+        .with_write_connection(
+            { "tests" },
+            [id = std::get<0>(params)](sqlite::database& db) {
+              db << "delete from tests where _id = ? ;" << id;
+              return sqlite3_changes(db.connection().get());
+            })
+        .then([](int deleted) {
+          http::HttpResponse response{};
+          response.status(deleted ? http::HttpStatusCode::NoContent : http::HttpStatusCode::NotFound);
+          return response;
+        });
+  }
+};
+
+//-----------------------------------------------------------------------
+
+struct ExportHandler : public http::HttpRequestHandler {
+  static inline http::HttpMethod method = http::HttpMethod::GET;
+  using Route                           = http::Route<"/api/export">;
+
+  using Row = std::tuple<int, int, std::string, double>;
+
+  ~ExportHandler() override = default;
+
+  HandleResult handle() override {
+    return cti::async([] {
+      http::HttpResponse response{};
+      response.status(http::HttpStatusCode::OK)
+          .header(http::HttpResponseHeaderKey::ContentType, http::Mime::application_json)
+          .stream(g_app.db.stream_rows<Row>([](sqlite::database& db, http::db::RowSink<Row>& rows) {
+            db << "select _id, age, name, weight from tests;" >>
+                [&](int id, int age, std::string name, double weight) {
+                  rows.push({ id, age, std::move(name), weight });
+                };
+          }));
+      return response;
+    });
+  }
+};
+
+//-----------------------------------------------------------------------
+
+struct AdultsHandler : public http::HttpCoroutineHandler {
+  static inline http::HttpMethod          method = http::HttpMethod::GET;
+  static inline http::ResponseCachePolicy cache{ .ttl = std::chrono::seconds{ 5 } };
+  using Route                             = http::Route<"/api/adults">;
+
+  ~AdultsHandler() override = default;
+
+  AsyncResult handle_async() override {
+    auto count = co_await g_app.db.query(
+        [](sqlite::database& db) {
+          int result;
+          db << "select count(*) from tests where age > ? ;" << 18 >> result;
+          return result;
+        },
+        cancellation);
+
+    http::HttpResponse response{};
+    response.status(http::HttpStatusCode::OK) << "adults count: " << count << "\r\n";
+    co_return response;
+  }
+};
+
+//-----------------------------------------------------------------------
+
 struct TestPartsHandler : public http::HttpRequestHandler {
   static inline http::HttpMethod method = http::HttpMethod::POST;
-  static inline const char*      path   = "/api/part/{int}/{string}";
+  using Route                           = http::Route<"/api/part/{int}/{string}">;
 
-  int         part{ 0 };
-  std::string name{};
-  std::string password{};
-  std::string username{};
+  Route::Params params{};
+  std::string   password{};
+  std::string   username{};
 
   ~TestPartsHandler() override = default;
 
   bool preprocess() override {
-    if (!unwrap_url(part, name)) {
-      return false;
-    }
     if (!request.body) {
       return false;
     }
@@ -109,6 +186,8 @@ struct TestPartsHandler : public http::HttpRequestHandler {
 
   HandleResult handle() override {
     return cti::async([this] {
+      auto [part, name] = params;
+
       http::HttpResponse response{};
       response.status(http::HttpStatusCode::OK)
           << "hello from parts handler!\r\n"
@@ -122,14 +201,45 @@ struct TestPartsHandler : public http::HttpRequestHandler {
 
 //-----------------------------------------------------------------------
 
+http::Task<> tarantool_example(http::db::tarantool::Client& tarantool) {
+  auto response = co_await tarantool.call("example_reverse", "hello", nullptr, 4.44);
+  http::g_log->info("{}", response.to_string());
+}
+
+//-----------------------------------------------------------------------
+
 int main(int, char**) {
-  http::TcpClient client{ std::make_unique<http::db::tarantool::Client>() };
+  g_app.db.start();
+
+  auto            tarantool     = std::make_unique<http::db::tarantool::Client>();
+  auto&           tarantool_ref = *tarantool;
+  http::TcpClient client{ std::move(tarantool) };
   client.connect("127.0.0.1", 3301u);
 
+  http::spawn(tarantool_example(tarantool_ref), [](auto, std::exception_ptr ex) {
+    http::unwrap_exception_ptr([](const std::exception& e) {
+      http::g_log->error("tarantool example error: {}", e.what());
+    })(ex);
+  });
+
   // http::HttpServer server;
+  // server.set_compression({ .enabled = true });
+  // server.set_response_cache({ .max_size = 16 * 1024 * 1024 });
+  // server.set_admission({ .max_in_flight = 256, .adaptive = true });
+  // server.set_rate_limit({ .rate = 50, .burst = 100 });
+  // server.set_connection_settings({ .max_connections = 10000, .header_timeout = std::chrono::seconds{ 5 } });
   // server.add_handler<ExampleHandler>();
   // server.add_handler<TestPartsHandler>();
   // server.add_handler<FillHandler>();
-  // server.listen("127.0.0.1", 5000);
+  // server.add_handler<DeleteTestHandler>();
+  // server.add_handler<ExportHandler>();
+  // server.add_handler<AdultsHandler>();
+  // server.add_static_files<"/static/{path}">({ .root = "public", .cache_control = "public, max-age=60" });
+  // if (!server.listen_handoff("/tmp/example-http.sock")) {
+  //   server.listen("127.0.0.1", 5000);
+  // }
+  // server.listen_unix("@example-http");
+  // server.serve_handoff("/tmp/example-http.sock", std::chrono::seconds{ 10 });
+  // server.shutdown_on_signals(std::chrono::seconds{ 10 });
   return http::run_main_loop();
 }
@@ -0,0 +1,66 @@
+#pragma once
+#include "http-server/pch.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+
+  struct AdmissionSettings {
+    size_t               max_in_flight{ 0 }; // handlers running at once, 0 is unlimited. upper bound of adaptive limit
+    bool                 adaptive{ false };  // limit follows handler latency, between min_in_flight and max_in_flight
+    size_t               min_in_flight{ 8 }; // lower bound of adaptive limit
+    std::chrono::seconds retry_after{ 1 };   // sent with 503 and 429 responses
+  };
+
+  //---------------------------------------------------------------
+  // gradient concurrency limit: latency of recent window is compared with long term
+  // average, limit shrinks when requests start queueing and grows back by sqrt(limit) otherwise.
+  class AdaptiveLimit {
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t                    min_window_samples{ 10 };
+    static constexpr std::chrono::milliseconds window{ 100 };
+    static constexpr double                    tolerance{ 2.0 }; // short term latency could be that much above long term
+    static constexpr double                    smoothing{ 0.2 };
+
+    double            limit_;
+    double            min_limit_;
+    double            max_limit_;
+    double            long_rtt_{ 0 };         // nanoseconds, exponential average
+    double            window_rtt_{ 0 };       // sum of samples
+    size_t            window_samples_{ 0 };
+    size_t            window_in_flight_{ 0 }; // max in window
+    Clock::time_point window_start_{ Clock::now() };
+
+  public:
+    AdaptiveLimit(size_t min_limit, size_t max_limit);
+
+    [[nodiscard]] size_t limit() const { return static_cast<size_t>(limit_); }
+
+    void on_sample(std::chrono::nanoseconds rtt, size_t in_flight);
+  };
+
+  //---------------------------------------------------------------
+  // counts running handlers and sheds requests above limit. used on loop thread only.
+  class AdmissionControl {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+  private:
+    AdmissionSettings            settings_{};
+    std::optional<AdaptiveLimit> adaptive_{};
+    size_t                       in_flight_{ 0 };
+
+  public:
+    void configure(AdmissionSettings settings);
+
+    [[nodiscard]] const AdmissionSettings& settings() const { return settings_; }
+    [[nodiscard]] size_t                   in_flight() const { return in_flight_; }
+    [[nodiscard]] size_t                   limit() const; // 0 is unlimited
+
+    /** @brief false if request should be shed, otherwise release should be called when handler is done. */
+    bool try_acquire();
+    void release(Clock::time_point admitted_at);
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
@@ -0,0 +1,59 @@
+#pragma once
+#include "http-server/pch.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+  // monotonic memory of one request: allocations are bumped in embedded block and
+  // released all at once when arena is returned to its pool. if block is exhausted
+  // next ones are taken from heap and freed on recycle, embedded block is reused.
+  class Arena {
+    friend class ArenaPool;
+
+  public:
+    static constexpr size_t block_size{ 4096 };
+
+    // returns arena to per loop pool instead of deleting it, deletes it after pool is destroyed
+    struct Recycle {
+      void operator()(Arena* arena) const;
+    };
+
+    using Ptr = std::unique_ptr<Arena, Recycle>;
+
+  private:
+    alignas(std::max_align_t) std::byte block_[block_size];
+    std::pmr::monotonic_buffer_resource resource_{ block_, block_size, std::pmr::new_delete_resource() };
+
+  public:
+    Arena() = default;
+
+    Arena(const Arena&)            = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /** @brief takes arena from pool of current loop thread, new one is created if pool is empty. */
+    static Ptr make();
+
+    [[nodiscard]] std::pmr::memory_resource* resource() { return &resource_; }
+  };
+
+  //---------------------------------------------------------------
+  // per loop free list of arenas, used on loop thread only.
+  class ArenaPool {
+    static constexpr size_t max_free{ 1024 }; // rest is deleted, pool keeps at most 4 MiB
+
+    std::vector<std::unique_ptr<Arena>> free_{};
+
+  public:
+    ~ArenaPool();
+
+    /** @brief pool of current thread, nullptr once it's destroyed by thread exit. */
+    static ArenaPool* local();
+
+    Arena::Ptr acquire();
+    void       release(Arena* arena);
+
+  private:
+    ArenaPool() = default;
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
@@ -0,0 +1,63 @@
+#pragma once
+#include "http-server/pch.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+  // bounded queue of batches from worker thread to loop thread.
+  // producer blocks while channel is full, consumer is woken up by async handle.
+  template <typename T>
+  class BatchChannel {
+    std::mutex                        lock_{};
+    std::condition_variable           cv_{};
+    std::deque<std::vector<T>>        batches_{};
+    size_t                            max_batches_;
+    bool                              cancelled_{ false };
+    std::shared_ptr<uvw::AsyncHandle> async_;
+
+  public:
+    BatchChannel(size_t max_batches, std::shared_ptr<uvw::AsyncHandle> async)
+        : max_batches_{ max_batches }
+        , async_{ std::move(async) } {}
+
+    /**
+     * @brief producer side, any thread.
+     * returns false if consumer has gone and producer should stop.
+     */
+    bool push(std::vector<T> batch) {
+      std::unique_lock<std::mutex> lock{ lock_ };
+      cv_.wait(lock, [this] { return cancelled_ || batches_.size() < max_batches_; });
+      if (cancelled_) {
+        return false;
+      }
+      batches_.emplace_back(std::move(batch));
+      async_->send(); // under lock: consumer closes async handle only after cancel()
+      return true;
+    }
+
+    /** @brief consumer side, loop thread. returns false if there is nothing to pop. */
+    bool pop(std::vector<T>& batch) {
+      {
+        std::unique_lock<std::mutex> _{ lock_ };
+        if (batches_.empty()) {
+          return false;
+        }
+        batch = std::move(batches_.front());
+        batches_.pop_front();
+      }
+      cv_.notify_one();
+      return true;
+    }
+
+    /** @brief consumer side, loop thread. unblocks producer and drops queued batches. */
+    void cancel() {
+      {
+        std::unique_lock<std::mutex> _{ lock_ };
+        cancelled_ = true;
+        batches_.clear();
+      }
+      cv_.notify_all();
+    }
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
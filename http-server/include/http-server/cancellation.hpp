@@ -0,0 +1,48 @@
+#pragma once
+#include "http-server/pch.hpp"
+#include "http-server/error.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+  // shared cancellation flag with optional deadline. thread safe.
+  // empty token (default constructed) is never cancelled.
+  class CancellationToken {
+    using Clock = std::chrono::steady_clock;
+
+    struct State {
+      std::atomic<bool>                                 cancelled{ false };
+      std::atomic<Clock::rep>                           deadline{ std::numeric_limits<Clock::rep>::max() };
+      std::mutex                                        lock{};
+      std::unordered_map<size_t, std::function<void()>> callbacks{};
+      size_t                                            next_callback_id{ 0 };
+    };
+
+    std::shared_ptr<State> state_{};
+
+  public:
+    CancellationToken() = default;
+
+    static CancellationToken make();
+
+    explicit operator bool() const { return state_ != nullptr; }
+
+    /** @brief true if cancel() was called or deadline has passed. */
+    [[nodiscard]] bool      cancelled() const;
+    [[nodiscard]] ErrorCode reason() const;
+
+    /** @brief callbacks registered by on_cancel are called on caller thread. */
+    void cancel();
+    void set_deadline(Clock::time_point deadline);
+    void set_timeout(std::chrono::milliseconds timeout) { set_deadline(Clock::now() + timeout); }
+
+    /**
+     * @brief cb is called on cancel(), or right away if token is already cancelled.
+     * cb should be short: it's called under lock, so after remove_on_cancel returns cb is not running.
+     * deadline does not call callbacks, it should be checked by cancelled().
+     */
+    size_t on_cancel(std::function<void()> cb);
+    void   remove_on_cancel(size_t id);
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
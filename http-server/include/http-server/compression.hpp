@@ -0,0 +1,80 @@
+#pragma once
+#include "http-server/pch.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+
+  enum class ContentEncoding : uint8_t {
+    Identity,
+    Gzip,
+    Deflate,
+  };
+
+  std::string_view to_string(ContentEncoding encoding);
+
+  /** @brief picks best supported encoding from Accept-Encoding header value, gzip is preferred on equal q. */
+  ContentEncoding negotiate_content_encoding(std::string_view accept_encoding);
+
+  /** @brief true for textual types: text, json, javascript, xml. */
+  bool is_compressible(std::string_view content_type);
+
+  //---------------------------------------------------------------
+
+  struct CompressionSettings {
+    bool   enabled{ false };
+    size_t min_size{ 1024 }; // smaller buffered responses are sent as is, streams are always compressed
+    int    level{ 6 };       // zlib level, 1 (fast) .. 9 (best)
+  };
+
+  //---------------------------------------------------------------
+  // zlib deflate stream, reused for many responses via reset().
+  class Compressor {
+    z_stream        stream_{};
+    ContentEncoding encoding_;
+    int             level_;
+
+  public:
+    Compressor(ContentEncoding encoding, int level);
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+    ~Compressor();
+
+    [[nodiscard]] ContentEncoding encoding() const { return encoding_; }
+
+    void reset(int level);
+
+    /** @brief appends compressed input to output, flushed so client could decode it right away. */
+    void write(std::string_view input, std::string& output);
+
+    /** @brief appends compressed input and stream trailer to output. */
+    void finish(std::string_view input, std::string& output);
+
+  private:
+    void deflate(std::string_view input, std::string& output, int flush);
+  };
+
+  //---------------------------------------------------------------
+
+  struct CompressorReleaser {
+    void operator()(Compressor* compressor) const noexcept;
+  };
+
+  using CompressorHandle = std::unique_ptr<Compressor, CompressorReleaser>;
+
+  // thread local free lists of compressors by encoding, so zlib state
+  // (about 256 KiB each) is allocated once per loop thread instead of per response.
+  class CompressorPool {
+    static constexpr size_t max_free{ 16 };
+
+    std::array<std::vector<std::unique_ptr<Compressor>>, 3> free_{}; // indexed by encoding
+
+  public:
+    /** @brief throws Error{CompressionFailed} if zlib can't be initialized. */
+    CompressorHandle acquire(ContentEncoding encoding, int level);
+    void             release(Compressor* compressor) noexcept;
+
+    static CompressorPool& local();
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
@@ -0,0 +1,206 @@
+#pragma once
+#include "http-server/pch.hpp"
+#include "http-server/scheduler.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+
+  namespace detail {
+    // thread local free lists of coroutine frames by size classes.
+    // frames of handler coroutines are of few sizes, so they are reused without touching heap.
+    class FramePool {
+      static constexpr size_t granularity{ 64 };
+      static constexpr size_t classes_count{ 32 }; // frames up to 2 KiB are pooled
+      static constexpr size_t max_free_blocks{ 256 };
+
+      struct FreeBlock {
+        FreeBlock* next;
+      };
+
+      std::array<FreeBlock*, classes_count> free_{};
+      std::array<size_t, classes_count>     free_count_{};
+
+    public:
+      FramePool() = default;
+      FramePool(const FramePool&) = delete;
+      FramePool& operator=(const FramePool&) = delete;
+      ~FramePool();
+
+      void* allocate(size_t size);
+      void  deallocate(void* ptr, size_t size) noexcept;
+
+      static FramePool& local();
+    };
+
+    // base of promise types, frame memory is taken from FramePool
+    struct PooledFrame {
+      static void* operator new(size_t size) { return FramePool::local().allocate(size); }
+      static void  operator delete(void* ptr, size_t size) noexcept { FramePool::local().deallocate(ptr, size); }
+    };
+
+    template <typename T>
+    struct TaskPromiseBase : PooledFrame {
+      std::variant<std::monostate, T, std::exception_ptr> result{};
+
+      template <typename U>
+      void return_value(U&& value) { result.template emplace<1>(std::forward<U>(value)); }
+      void unhandled_exception() noexcept { result.template emplace<2>(std::current_exception()); }
+
+      T take_result() {
+        if (result.index() == 2) {
+          std::rethrow_exception(std::get<2>(result));
+        }
+        return std::move(std::get<1>(result));
+      }
+    };
+
+    template <>
+    struct TaskPromiseBase<void> : PooledFrame {
+      std::exception_ptr exception{};
+
+      void return_void() noexcept {}
+      void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+      void take_result() {
+        if (exception) {
+          std::rethrow_exception(exception);
+        }
+      }
+    };
+  } // namespace detail
+
+  //---------------------------------------------------------------
+  // lazy coroutine: started when awaited, resumes awaiting coroutine when done.
+  template <typename T = void>
+  class [[nodiscard]] Task {
+  public:
+    struct promise_type : detail::TaskPromiseBase<T> {
+      std::coroutine_handle<> continuation{};
+
+      Task get_return_object() noexcept { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+
+      std::suspend_always initial_suspend() noexcept { return {}; }
+
+      auto final_suspend() noexcept {
+        struct FinalAwaiter {
+          bool await_ready() const noexcept { return false; }
+
+          std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+            auto continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+          }
+
+          void await_resume() const noexcept {}
+        };
+        return FinalAwaiter{};
+      }
+    };
+
+  private:
+    std::coroutine_handle<promise_type> handle_;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : handle_{ handle } {}
+
+  public:
+    Task(Task&& other) noexcept
+        : handle_{ std::exchange(other.handle_, nullptr) } {}
+
+    Task& operator=(Task&& other) noexcept {
+      if (this != &other) {
+        if (handle_) {
+          handle_.destroy();
+        }
+        handle_ = std::exchange(other.handle_, nullptr);
+      }
+      return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+      if (handle_) {
+        handle_.destroy();
+      }
+    }
+
+    auto operator co_await() && noexcept {
+      struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+          handle.promise().continuation = continuation;
+          return handle;
+        }
+
+        T await_resume() { return handle.promise().take_result(); }
+      };
+      return Awaiter{ handle_ };
+    }
+  };
+
+  //---------------------------------------------------------------
+
+  namespace detail {
+    // eagerly started coroutine which destroys itself when done
+    struct DetachedTask {
+      struct promise_type : PooledFrame {
+        DetachedTask        get_return_object() noexcept { return {}; }
+        std::suspend_never  initial_suspend() noexcept { return {}; }
+        std::suspend_never  final_suspend() noexcept { return {}; }
+        void                return_void() noexcept {}
+        void                unhandled_exception() noexcept { std::terminate(); }
+      };
+    };
+
+    template <typename T>
+    using SpawnResult = std::optional<std::conditional_t<std::is_void_v<T>, std::monostate, T>>;
+  } // namespace detail
+
+  /**
+   * @brief starts task from non coroutine code.
+   * callback(detail::SpawnResult<T>, std::exception_ptr) is called when task is done,
+   * value is empty if task has thrown.
+   */
+  template <typename T, typename TCallback>
+  detail::DetachedTask spawn(Task<T> task, TCallback callback) {
+    detail::SpawnResult<T> value{};
+    std::exception_ptr     exception{};
+    try {
+      if constexpr (std::is_void_v<T>) {
+        co_await std::move(task);
+        value.emplace();
+      } else {
+        value.emplace(co_await std::move(task));
+      }
+    } catch (...) {
+      exception = std::current_exception();
+    }
+    callback(std::move(value), std::move(exception));
+  }
+
+  //---------------------------------------------------------------
+
+  // timer lives in awaiting coroutine frame, so destroyed coroutine is not resumed
+  class SleepAwaitable {
+    std::chrono::milliseconds timeout_;
+    std::coroutine_handle<>   handle_{};
+    Scheduler::Timer          timer_{ [this] { handle_.resume(); } };
+
+  public:
+    explicit SleepAwaitable(std::chrono::milliseconds timeout)
+        : timeout_{ timeout } {}
+
+    bool await_ready() const noexcept { return timeout_.count() <= 0; }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {}
+  };
+
+  /** @brief co_await sleep(...) resumes coroutine on loop thread after timeout. */
+  inline SleepAwaitable sleep(std::chrono::milliseconds timeout) { return SleepAwaitable{ timeout }; }
+
+  //---------------------------------------------------------------
+} // namespace http
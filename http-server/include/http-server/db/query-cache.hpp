@@ -0,0 +1,143 @@
+#pragma once
+#include "http-server/pch.hpp"
+
+namespace http::db {
+  //---------------------------------------------------------------
+
+  struct QueryCacheSettings {
+    size_t                    max_entries{ 0 }; // 0 disables cache
+    std::chrono::milliseconds default_ttl{ 1000 };
+  };
+
+  //---------------------------------------------------------------
+
+  // made by cached_query(...): key and executed statement come from the same sql and parameters
+  struct CachedQuery {
+    std::string                                    key;    // sql text and bound parameters, result type is added on lookup
+    std::vector<std::string>                       tables; // write to any of these tables drops cached result
+    std::chrono::milliseconds                      ttl{ 0 }; // 0 means QueryCacheSettings::default_ttl
+    std::string                                    sql{};
+    std::function<void(sqlite::database_binder&)> bind{}; // binds parameters to statement made from sql
+  };
+
+  namespace detail {
+    // every parameter is tagged with its type and encoded exactly, so 5 and "5" or
+    // close doubles never share a key.
+    inline void append_query_param_bytes(std::string& key, char tag, std::string_view bytes) {
+      key += '\x1f';
+      key += tag;
+      key += std::to_string(bytes.size());
+      key += ':';
+      key += bytes;
+    }
+
+    template <typename T>
+    void append_query_param(std::string& key, const T& value) {
+      if constexpr (std::is_same_v<T, bool>) {
+        append_query_param_bytes(key, 'b', value ? "1" : "0");
+      } else if constexpr (std::is_integral_v<T> || std::is_floating_point_v<T>) {
+        char buffer[64];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value); // shortest round-trip for floating point
+        append_query_param_bytes(key, std::is_integral_v<T> ? 'i' : 'f', { buffer, static_cast<size_t>(result.ptr - buffer) });
+      } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        append_query_param_bytes(key, 's', value);
+      } else if constexpr (std::is_convertible_v<const T&, std::u16string_view>) {
+        std::u16string_view text = value;
+        append_query_param_bytes(key, 'u', { reinterpret_cast<const char*>(text.data()), text.size() * sizeof(char16_t) });
+      } else if constexpr (requires { typename T::value_type; value.data(); value.size(); }) {
+        static_assert(std::is_trivially_copyable_v<typename T::value_type>, "blob parameter should be vector of plain values");
+        append_query_param_bytes(key, 'v', { reinterpret_cast<const char*>(value.data()), value.size() * sizeof(typename T::value_type) });
+      } else {
+        static_assert(sizeof(T) == 0, "unsupported query parameter type");
+      }
+    }
+
+    template <typename T>
+    void append_query_param(std::string& key, const std::optional<T>& value) {
+      if (value) {
+        append_query_param(key, *value);
+      } else {
+        append_query_param_bytes(key, 'n', {});
+      }
+    }
+
+    inline void append_query_param(std::string& key, std::nullptr_t) {
+      append_query_param_bytes(key, 'n', {});
+    }
+
+    // address of inline variable is unique per type in whole program, unlike typeid name it's not implementation defined
+    template <typename T>
+    inline constexpr char result_type_tag{};
+
+    template <typename T>
+    void append_result_type(std::string& key) {
+      char buffer[2 * sizeof(uintptr_t)];
+      auto result = std::to_chars(buffer, buffer + sizeof(buffer), reinterpret_cast<uintptr_t>(&result_type_tag<T>), 16);
+      append_query_param_bytes(key, 't', { buffer, static_cast<size_t>(result.ptr - buffer) });
+    }
+
+    // parameters are kept by value until query runs, string literals and pointers become strings
+    template <typename T>
+    using stored_query_param_t = std::conditional_t<
+        std::is_convertible_v<const T&, std::string_view>, std::string,
+        std::conditional_t<std::is_convertible_v<const T&, std::u16string_view>, std::u16string, std::decay_t<T>>>;
+  } // namespace detail
+
+  /**
+   * @brief makes cache key from sql text and parameters, and binds the same parameters
+   * to statement when query runs, see Sqlite::with_cached_connection.
+   */
+  template <typename... TArgs>
+  CachedQuery cached_query(std::string sql, std::vector<std::string> tables, const TArgs&... args) {
+    auto params = std::make_tuple(detail::stored_query_param_t<TArgs>(args)...);
+
+    CachedQuery query{ .key = sql, .tables = std::move(tables), .sql = std::move(sql) };
+    std::apply([&query](const auto&... param) { (detail::append_query_param(query.key, param), ...); }, params);
+    query.bind = [params = std::move(params)](sqlite::database_binder& statement) {
+      std::apply([&statement](const auto&... param) { ((statement << param), ...); }, params);
+    };
+    return query;
+  }
+
+  //---------------------------------------------------------------
+  // lru cache of query results.
+  // not thread safe: used from loop thread only, so hit does not touch threadpool at all.
+  // every table has version, which is incremented on write. entry is valid only
+  // while versions of its tables are the same as they were when query was started.
+  class QueryCache {
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+      std::string              key;
+      std::any                 value;
+      Clock::time_point        expires;
+      std::vector<std::string> tables;
+      std::vector<uint64_t>    versions;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    QueryCacheSettings                                        settings_;
+    EntryList                                                 lru_{}; // front is most recently used
+    std::unordered_map<std::string_view, EntryList::iterator> index_{};
+    std::unordered_map<std::string, uint64_t>                 table_versions_{};
+
+  public:
+    explicit QueryCache(QueryCacheSettings settings)
+        : settings_{ settings } {}
+
+    /** @brief returns cached value or nullptr if there is no valid entry. */
+    const std::any* find(std::string_view key);
+
+    /** @brief should be taken before query is started and passed to put(). */
+    std::vector<uint64_t> versions(const std::vector<std::string>& tables) const;
+
+    void put(const CachedQuery& query, std::vector<uint64_t> versions, std::any value);
+    void invalidate(const std::vector<std::string>& tables);
+
+  private:
+    void erase(EntryList::iterator it);
+  };
+
+  //---------------------------------------------------------------
+} // namespace http::db
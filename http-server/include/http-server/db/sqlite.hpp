@@ -1,52 +1,402 @@
 #pragma once
 #include "http-server/pool-worker.hpp"
 #include "http-server/functor.hpp"
+#include "http-server/db/query-cache.hpp"
+#include "http-server/batch-channel.hpp"
+#include "http-server/http-stream.hpp"
+#include "http-server/utils.hpp"
 #include <sqlite_modern_cpp.h>
 
 namespace http::db {
   //---------------------------------------------------------------
 
   struct SqliteSettings {
-    std::string           db_name;
-    size_t                max_pool_size{ 64 };
-    sqlite::sqlite_config config{
+    std::string               db_name;
+    size_t                    min_pool_size{ 0 }; // connections opened by Sqlite::start()
+    size_t                    max_pool_size{ 64 };
+    std::chrono::milliseconds idle_timeout{ std::chrono::minutes{ 5 } };
+    sqlite::sqlite_config     config{
       .flags    = sqlite::OpenFlags::READWRITE | sqlite::OpenFlags::CREATE,
       .zVfs     = nullptr,
       .encoding = sqlite::Encoding::ANY,
     };
+    QueryCacheSettings        query_cache{};
   };
 
   //---------------------------------------------------------------
 
+  // tables written through connections are collected by update hook while query cache is enabled
   class SqlitePool : public Pool<sqlite::database> {
-    SqliteSettings settings_;
+    static constexpr int progress_handler_period{ 1000 }; // virtual machine instructions
+
+    SqliteSettings           settings_;
+    std::mutex               written_lock_{};
+    std::vector<std::string> written_tables_{};
+    std::atomic<bool>        has_written_{ false };
+
+    static std::vector<std::string>& task_written_tables() {
+      static thread_local std::vector<std::string> tables;
+      return tables;
+    }
 
   public:
     explicit SqlitePool(SqliteSettings settings)
-        : settings_{ std::move(settings) }
-        , Pool<sqlite::database>{ settings.max_pool_size } {}
+        : Pool<sqlite::database>{ PoolSettings{
+              .min_size     = settings.min_pool_size,
+              .max_size     = settings.max_pool_size,
+              .idle_timeout = settings.idle_timeout,
+          } }
+        , settings_{ std::move(settings) } {}
 
     ~SqlitePool() override = default;
 
+    [[nodiscard]] const SqliteSettings& sqlite_settings() const { return settings_; }
+
+    // deadline is checked by progress handler, so long statement is stopped without loop involved
+    void begin_task(sqlite::database& db, const CancellationToken& token) override {
+      if (settings_.query_cache.max_entries != 0) {
+        // rows are changed on this thread, so tables are collected without lock until end of task
+        sqlite3_update_hook(
+            db.connection().get(), [](void*, int, const char*, const char* table, sqlite3_int64) {
+              auto& tables = task_written_tables();
+              if (std::find(tables.begin(), tables.end(), table) == tables.end()) {
+                tables.emplace_back(table);
+              }
+            },
+            nullptr);
+      }
+      if (!token) {
+        return;
+      }
+      sqlite3_progress_handler(
+          db.connection().get(), progress_handler_period, [](void* data) -> int {
+            return static_cast<const CancellationToken*>(data)->cancelled() ? 1 : 0;
+          },
+          const_cast<CancellationToken*>(&token));
+    }
+
+    void end_task(sqlite::database& db) override {
+      sqlite3_progress_handler(db.connection().get(), 0, nullptr, nullptr);
+      sqlite3_update_hook(db.connection().get(), nullptr, nullptr);
+
+      if (auto& tables = task_written_tables(); !tables.empty()) {
+        std::unique_lock<std::mutex> _{ written_lock_ };
+        for (auto& table : tables) {
+          if (std::find(written_tables_.begin(), written_tables_.end(), table) == written_tables_.end()) {
+            written_tables_.push_back(std::move(table));
+          }
+        }
+        has_written_.store(true, std::memory_order_release);
+        tables.clear();
+      }
+    }
+
+    /** @brief tables written since previous call, thread safe. */
+    std::vector<std::string> take_written_tables() {
+      if (!has_written_.load(std::memory_order_acquire)) {
+        return {};
+      }
+      std::unique_lock<std::mutex> _{ written_lock_ };
+      has_written_.store(false, std::memory_order_relaxed);
+      return std::exchange(written_tables_, {});
+    }
+
+    void interrupt_resource(sqlite::database& db) override {
+      sqlite3_interrupt(db.connection().get());
+    }
+
   protected:
     sqlite::database* create_resource() override {
       return new sqlite::database(settings_.db_name, settings_.config);
     }
+
+    // connection left inside of transaction by failed action is not reused
+    bool validate_resource(sqlite::database& db) override {
+      return sqlite3_get_autocommit(db.connection().get()) != 0;
+    }
+  };
+
+  //-----------------------------------------------------------------------
+
+  // collects rows on db thread and passes them to loop thread by batches
+  template <typename TRow>
+  class RowSink {
+    BatchChannel<TRow>& channel_;
+    std::vector<TRow>   batch_{};
+    size_t              batch_size_;
+
+  public:
+    RowSink(BatchChannel<TRow>& channel, size_t batch_size)
+        : channel_{ channel }
+        , batch_size_{ batch_size } {
+      batch_.reserve(batch_size_);
+    }
+
+    /** @brief throws when client has gone, this stops the query. */
+    void push(TRow row) {
+      batch_.emplace_back(std::move(row));
+      if (batch_.size() >= batch_size_) {
+        flush();
+      }
+    }
+
+    void flush() {
+      if (batch_.empty()) {
+        return;
+      }
+      if (!channel_.push(std::move(batch_))) {
+        throw Error{ ErrorCode::StreamClosed };
+      }
+      batch_ = {};
+      batch_.reserve(batch_size_);
+    }
+  };
+
+  //-----------------------------------------------------------------------
+  // writes rows as json array while query is running.
+  // query runs in threadpool, rows are serialized on loop thread and written as response chunks.
+  // db thread waits when max_batches are not yet written, loop waits for socket write queue to drain.
+  // channel and query are cancelled when client disconnects, so db thread stops the query.
+  template <typename TRow>
+  class SqliteRowStream : public HttpResponseStream
+      , public std::enable_shared_from_this<SqliteRowStream<TRow>> {
+    using Action = std::function<void(sqlite::database&, RowSink<TRow>&)>;
+
+    static constexpr size_t max_batches{ 4 };
+    static constexpr size_t max_pending_bytes{ 64 * 1024 };
+
+    PoolWorker<sqlite::database>&       pool_worker_;
+    Action                              action_;
+    size_t                              batch_size_;
+    std::shared_ptr<uvw::AsyncHandle>   async_{};
+    std::shared_ptr<BatchChannel<TRow>> channel_{};
+    std::unique_ptr<HttpChunkWriter>    writer_{};
+    CancellationToken                   cancellation_{ CancellationToken::make() }; // interrupts query
+    bool                                producer_done_{ false };
+    bool                                empty_{ true };
+
+  public:
+    SqliteRowStream(PoolWorker<sqlite::database>& pool_worker, Action action, size_t batch_size)
+        : pool_worker_{ pool_worker }
+        , action_{ std::move(action) }
+        , batch_size_{ batch_size } {}
+
+    ~SqliteRowStream() override = default;
+
+    void start(std::unique_ptr<HttpChunkWriter> writer) override {
+      writer_  = std::move(writer);
+      async_   = uvw::Loop::getDefault()->resource<uvw::AsyncHandle>();
+      channel_ = std::make_shared<BatchChannel<TRow>>(max_batches, async_);
+
+      async_->on<uvw::AsyncEvent>([self = this->shared_from_this()](const uvw::AsyncEvent&, uvw::AsyncHandle&) {
+        self->drain();
+      });
+
+      // producer could be blocked on full channel while nothing is drained, so it's cancelled right away
+      writer_->on_close([self = this->shared_from_this()] {
+        g_log->debug("client has gone, stop streaming rows");
+        self->finish(false);
+      });
+      if (!writer_) {
+        return;
+      }
+
+      pool_worker_
+          .template with_resource<std::nullptr_t>(
+              [channel = channel_, action = action_, batch_size = batch_size_](sqlite::database& db) {
+                RowSink<TRow> sink{ *channel, batch_size };
+                action(db, sink);
+                sink.flush();
+                return nullptr;
+              },
+              cancellation_)
+          .then([self = this->shared_from_this()](std::nullptr_t) {
+            self->producer_done_ = true;
+            self->drain();
+          })
+          .fail(http::unwrap_exception_ptr([self = this->shared_from_this()](const std::exception& ex) {
+            // query is cancelled by finish(false) when client has gone, that's not an error
+            if (auto error = dynamic_cast<const Error*>(&ex);
+                error && (error->code() == ErrorCode::Cancelled || error->code() == ErrorCode::StreamClosed)) {
+              g_log->debug("streaming rows stopped: {}", ex.what());
+            } else {
+              g_log->error("error while streaming rows: {}", ex.what());
+            }
+            self->finish(false);
+          }));
+    }
+
+  private:
+    void drain() {
+      if (!writer_) {
+        return;
+      }
+      if (writer_->closed()) {
+        g_log->debug("client has gone, stop streaming rows");
+        finish(false);
+        return;
+      }
+
+      std::vector<TRow> batch;
+      while (writer_->pending() < max_pending_bytes && channel_->pop(batch)) {
+        std::string chunk;
+        for (auto& row : batch) {
+          chunk += empty_ ? '[' : ',';
+          chunk += nlohmann::json(row).dump();
+          empty_ = false;
+        }
+        writer_->write(chunk);
+      }
+
+      if (writer_->pending() >= max_pending_bytes) {
+        writer_->on_drain([self = this->shared_from_this()] { self->drain(); });
+      } else if (producer_done_) {
+        finish(true);
+      }
+    }
+
+    void finish(bool ok) {
+      if (!writer_) {
+        return;
+      }
+
+      if (!ok) {
+        cancellation_.cancel(); // before channel, so producer fails with Cancelled
+      }
+      channel_->cancel();
+      async_->clear<uvw::AsyncEvent>();
+      async_->close();
+
+      if (ok) {
+        writer_->write(empty_ ? "[]" : "]");
+        writer_->end();
+      } else {
+        writer_->abort();
+      }
+      writer_.reset();
+    }
   };
 
   //-----------------------------------------------------------------------
 
   class Sqlite {
+    std::unique_ptr<QueryCache>  query_cache_;
+    SqlitePool*                  pool_; // owned by pool_worker_
     PoolWorker<sqlite::database> pool_worker_;
 
+    explicit Sqlite(std::unique_ptr<SqlitePool> pool)
+        : query_cache_{ pool->sqlite_settings().query_cache.max_entries ? std::make_unique<QueryCache>(pool->sqlite_settings().query_cache) : nullptr }
+        , pool_{ pool.get() }
+        , pool_worker_{ std::move(pool) } {}
+
+    // tables collected by update hook of pool connections
+    void apply_written_tables() {
+      if (auto tables = pool_->take_written_tables(); !tables.empty()) {
+        query_cache_->invalidate(tables);
+      }
+    }
+
   public:
     explicit Sqlite(SqliteSettings settings)
-        : pool_worker_{ std::make_unique<http::db::SqlitePool>(std::move(settings)) } {}
+        : Sqlite{ std::make_unique<SqlitePool>(std::move(settings)) } {}
+
+    /** @brief opens min_pool_size connections in threadpool and starts reaping idle ones. */
+    void start() { pool_worker_.start(); }
+
+    /**
+     * @brief see PoolWorker::with_resource for token semantics.
+     * rows written to rowid tables drop cached results which read from them, other writes
+     * (WITHOUT ROWID tables, DELETE without WHERE) should go through with_write_connection.
+     */
+    template <typename TAction>
+    auto with_connection(TAction&& action, CancellationToken token = {}) {
+      using TUserData = typename FunctorInfo<TAction>::ReturnType;
+      return pool_worker_.template with_resource<TUserData>(action, std::move(token));
+    }
 
+    /** @brief same as with_connection, but for coroutines: auto result = co_await db.query(...). */
     template <typename TAction>
-    auto with_connection(TAction&& action) {
+    auto query(TAction&& action, CancellationToken token = {}) {
       using TUserData = typename FunctorInfo<TAction>::ReturnType;
-      return pool_worker_.template with_resource<TUserData>(action);
+      return pool_worker_.template await_resource<TUserData>(std::forward<TAction>(action), std::move(token));
+    }
+
+    /**
+     * @brief runs sql of query made by cached_query(sql, tables, args...) with its parameters bound,
+     * action reads rows from statement: [](sqlite::database_binder& rows) { int count; rows >> count; return count; }.
+     * result is taken from query cache if it is there. should be called from loop thread.
+     */
+    template <typename TAction>
+    auto with_cached_connection(CachedQuery query, TAction&& action, CancellationToken token = {}) {
+      using TUserData = typename FunctorInfo<TAction>::ReturnType;
+
+      auto run = [sql = query.sql, bind = query.bind, action = std::forward<TAction>(action)](sqlite::database& db) mutable {
+        auto statement = db << sql;
+        bind(statement);
+        return action(statement);
+      };
+
+      if (!query_cache_) {
+        return cti::continuable<TUserData>{ with_connection(std::move(run), std::move(token)) };
+      }
+
+      // other call site could cache same query with different result type
+      detail::append_result_type<TUserData>(query.key);
+
+      apply_written_tables();
+      if (auto value = query_cache_->find(query.key)) {
+        return cti::continuable<TUserData>{ cti::make_ready_continuable<TUserData>(std::any_cast<TUserData>(*value)) };
+      }
+
+      auto versions = query_cache_->versions(query.tables);
+      return cti::continuable<TUserData>{
+        with_connection(std::move(run), std::move(token))
+            .then([this, query = std::move(query), versions = std::move(versions)](TUserData data) mutable {
+              apply_written_tables(); // write could be done while query was running
+              query_cache_->put(query, std::move(versions), data);
+              return data;
+            })
+      };
+    }
+
+    /**
+     * @brief same as with_connection, but drops cached results of queries which read from tables.
+     * needed for writes which update hook doesn't see, see with_connection. should be called from loop thread.
+     */
+    template <typename TAction>
+    auto with_write_connection(std::vector<std::string> tables, TAction&& action, CancellationToken token = {}) {
+      using TUserData = typename FunctorInfo<TAction>::ReturnType;
+
+      return cti::make_continuable<TUserData>(
+          [this, tables = std::move(tables), action = std::forward<TAction>(action), token = std::move(token)](cti::promise<TUserData>&& promise) mutable {
+            auto shared_promise = std::make_shared<cti::promise<TUserData>>(std::move(promise));
+            with_connection(std::move(action), std::move(token))
+                .then([this, tables, shared_promise](TUserData data) {
+                  invalidate(tables);
+                  shared_promise->set_value(std::move(data));
+                })
+                .fail([this, tables, shared_promise](cti::exception_t ex) {
+                  invalidate(tables); // failed write could be partially applied
+                  shared_promise->set_exception(std::move(ex));
+                });
+          });
+    }
+
+    /** @brief drops cached results of queries which read from tables. */
+    void invalidate(const std::vector<std::string>& tables) {
+      if (query_cache_) {
+        query_cache_->invalidate(tables);
+      }
+    }
+
+    /**
+     * @brief returns response body stream, query is started when response headers are written.
+     * action is void(sqlite::database&, RowSink<TRow>&), every row should be pushed to sink.
+     * TRow should be convertible to json.
+     */
+    template <typename TRow, typename TAction>
+    std::shared_ptr<HttpResponseStream> stream_rows(TAction&& action, size_t batch_size = 256) {
+      return std::make_shared<SqliteRowStream<TRow>>(pool_worker_, std::forward<TAction>(action), batch_size);
     }
   };
 
@@ -3,74 +3,202 @@
 #include "http-server/tcp-client.hpp"
 #include "http-server/db/tarantool/enums.hpp"
 #include "http-server/db/tarantool/types.hpp"
+#include "http-server/coroutine.hpp"
+#include "http-server/scheduler.hpp"
+#include "http-server/error.hpp"
 #include "http-server/log.hpp"
 
 namespace http::db::tarantool {
+  class Client;
+
+  //---------------------------------------------------------------
+  // result of Client::call, co_await resumes coroutine with server response.
+  // awaitable is registered in client while suspended, and removes itself if coroutine is destroyed first.
+  class CallAwaitable {
+    friend class Client;
+
+    Client*                                    client_; // nullptr when call is not registered in client anymore
+    unsigned int                               sync_;
+    std::unique_ptr<RequestCall>               request_;
+    ServerResponse                             response_{};
+    std::coroutine_handle<>                    handle_{};
+    bool                                       closed_{ false };
+    std::weak_ptr<std::vector<CallAwaitable*>> closing_{}; // resumptions posted by ~Client
+
+  public:
+    CallAwaitable(Client* client, unsigned int sync, std::unique_ptr<RequestCall> request)
+        : client_{ client }
+        , sync_{ sync }
+        , request_{ std::move(request) } {}
+
+    CallAwaitable(const CallAwaitable&)            = delete;
+    CallAwaitable& operator=(const CallAwaitable&) = delete;
+
+    ~CallAwaitable();
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+
+    ServerResponse await_resume() {
+      if (closed_) {
+        throw http::Error{ http::ErrorCode::ConnectionClosed };
+      }
+      return std::move(response_);
+    }
+  };
+
+  //---------------------------------------------------------------
+
   class Client : public ITcpClientUser {
+    friend class CallAwaitable;
+
+    // every response is prefixed by its size packed as msgpack uint32
+    static constexpr size_t size_prefix_length{ 5 };
+
     enum class State {
       PreHello,
-      Waiting,
       Ready,
     } state_ = State::PreHello;
 
+    std::string                                      buffer_{}; // received data which is not parsed yet
+    unsigned int                                     next_sync_{ 0 };
+    std::unordered_map<unsigned int, CallAwaitable*> pending_{}; // nullptr if coroutine is gone before response
+    std::vector<CallAwaitable*>                      queued_{};  // calls made before greeting
+
   public:
     ~Client() override {
       g_log->info("~tarantool::Client");
+
+      // coroutines are resumed on next loop iteration, so they don't run inside destructor of their client
+      auto calls = std::make_shared<std::vector<CallAwaitable*>>(std::move(queued_));
+      for (auto& [sync, call] : pending_) {
+        if (call) {
+          calls->push_back(call);
+        }
+      }
+      if (calls->empty()) {
+        return;
+      }
+      for (auto* call : *calls) {
+        call->client_  = nullptr;
+        call->closed_  = true;
+        call->closing_ = calls;
+      }
+      std::reverse(calls->begin(), calls->end());
+      Scheduler::local().post([calls] {
+        while (!calls->empty()) {
+          auto call = calls->back();
+          calls->pop_back();
+          call->closing_.reset();
+          call->handle_.resume();
+        }
+      });
+    }
+
+    /**
+     * @brief calls stored function, should be co_await'ed:
+     * auto response = co_await client.call("func", arg1, arg2);
+     */
+    template <typename... TArgs>
+    CallAwaitable call(std::string_view function, TArgs&&... args) {
+      auto sync    = next_sync_++;
+      auto request = std::make_unique<RequestCall>(sync, function);
+      pack_variadic_tuple(request->packer(), std::forward<TArgs>(args)...);
+      return CallAwaitable{ this, sync, std::move(request) };
     }
 
     void on_data(char* data, size_t size) override {
-      std::string_view incoming{ data, size };
-
-      switch (state_) {
-        case State::PreHello: {
-          http::g_log->debug("incoming.size(): {}, sizeof(HelloPacket): {}", incoming.size(), sizeof(HelloPacket));
-          assert(incoming.size() == sizeof(HelloPacket));
-          auto hello = reinterpret_cast<HelloPacket*>(data);
-          http::g_log->debug("recieved hello from tarantool instance:\n{}", hello->to_string());
-          state_ = State::Ready;
-          [[fallthrough]];
+      buffer_.append(data, size);
+
+      if (state_ == State::PreHello) {
+        if (buffer_.size() < sizeof(HelloPacket)) {
+          return;
         }
+        auto hello = reinterpret_cast<HelloPacket*>(buffer_.data());
+        http::g_log->debug("recieved hello from tarantool instance:\n{}", hello->to_string());
+        buffer_.erase(0, sizeof(HelloPacket));
+        state_ = State::Ready;
+
+        for (auto* call : std::exchange(queued_, {})) {
+          send(call);
+        }
+      }
 
-        case State::Ready: {
-          write_some_data();
+      size_t offset{ 0 };
+      while (buffer_.size() - offset >= size_prefix_length) {
+        auto prefix = reinterpret_cast<const unsigned char*>(buffer_.data() + offset);
+        auto size   = (uint32_t(prefix[1]) << 24) | (uint32_t(prefix[2]) << 16) |
+                    (uint32_t(prefix[3]) << 8) | uint32_t(prefix[4]);
+        if (buffer_.size() - offset < size_prefix_length + size) {
           break;
         }
 
-        case State::Waiting: {
-          http::g_log->info("read_callback on waiting! {}", incoming);
+        ServerResponse response;
+        response.parse(std::string_view{ buffer_.data() + offset, size_prefix_length + size });
+        offset += size_prefix_length + size;
+        dispatch(std::move(response));
+      }
+      buffer_.erase(0, offset);
+    }
 
-          ServerResponse response;
-          response.parse(incoming);
-          g_log->info("{}", response.to_string());
+    void on_hello() override {}
 
-          http::g_log->info("waiting done -> ready");
-          state_ = State::Ready;
+  private:
+    void enqueue(CallAwaitable* call) {
+      if (state_ == State::PreHello) {
+        queued_.push_back(call);
+      } else {
+        send(call);
+      }
+    }
 
-          // write_some_data();
-          break;
-        }
+    void send(CallAwaitable* call) {
+      pending_.emplace(call->sync_, call);
+      call->request_->write(client_);
+    }
 
-        default: break;
+    void forget(CallAwaitable* call) {
+      std::erase(queued_, call);
+      // response is still expected, it's dropped when it comes
+      if (auto it = pending_.find(call->sync_); it != pending_.end()) {
+        it->second = nullptr;
       }
     }
 
-    void write_some_data() {
-      // RequestCall request{ 0, "example_insert" };
-      // request.packer().pack_array(2);
-      // request.packer().pack_unsigned_int(5);
-      // request.packer().pack_array(2);
-      // request.packer().pack_str(2);
-      // request.packer().pack_str_body("ab", 2);
-      // request.packer().pack_double(3.15);
+    void dispatch(ServerResponse response) {
+      auto it = pending_.find(response.header.sync);
+      if (it == pending_.end()) {
+        g_log->error("tarantool response with unknown sync {}", response.header.sync);
+        return;
+      }
 
+      auto call = it->second;
+      pending_.erase(it);
+      if (call) {
+        call->client_   = nullptr; // not registered anymore
+        call->response_ = std::move(response);
+        call->handle_.resume();
+      }
+    }
+  };
 
-      RequestCall request{ 0, "example_reverse" };
-      pack_variadic_tuple(request.packer(), "hello", nullptr, 4.44);
-      request.write(client_);
+  //---------------------------------------------------------------
 
-      state_ = State::Waiting;
+  inline CallAwaitable::~CallAwaitable() {
+    if (!handle_) {
+      return; // never suspended, so not registered
+    }
+    if (client_) {
+      client_->forget(this);
+    } else if (auto calls = closing_.lock()) {
+      std::erase(*calls, this);
     }
+  }
 
-    void on_hello() override {}
-  };
-} // namespace http::db::tarantool
\ No newline at end of file
+  inline void CallAwaitable::await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    client_->enqueue(this);
+  }
+
+  //---------------------------------------------------------------
+} // namespace http::db::tarantool
@@ -168,17 +168,22 @@ namespace http::db::tarantool {
 
       msgpack::object_handle oh;
 
-      assert(pac.next(oh)); //size, skipping
+      bool has_next = pac.next(oh); //size, skipping
+      assert(has_next);
       auto size = oh.get().as<unsigned int>();
       assert(size + 5 == data.size());
 
-      assert(pac.next(oh));
+      has_next = pac.next(oh);
+      assert(has_next);
       header.parse(oh.get());
 
-      assert(pac.next(oh));
+      has_next = pac.next(oh);
+      assert(has_next);
       body.parse(oh.get());
 
-      assert(!pac.next(oh));
+      has_next = pac.next(oh);
+      assert(!has_next);
+      (void) has_next;
     }
 
     std::string to_string() {
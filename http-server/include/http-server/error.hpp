@@ -7,7 +7,12 @@ namespace http {
 #define X_ERROR_CODE_ENUM(X) \
   X(None)                    \
   X(Exception)               \
-  X(NoConnectionsInPool)
+  X(NoConnectionsInPool)     \
+  X(StreamClosed)            \
+  X(Cancelled)               \
+  X(DeadlineExceeded)        \
+  X(ConnectionClosed)        \
+  X(CompressionFailed)
 
   enum class ErrorCode {
 #define EXPAND_X_ERROR_CODE_ENUM(val) val,
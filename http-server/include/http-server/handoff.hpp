@@ -0,0 +1,34 @@
+#pragma once
+#include "http-server/pch.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+  // listening sockets are passed between processes over unix socket with SCM_RIGHTS.
+  // new process: connect, receive sockets, start listening, send one byte, close.
+  // old process gives up listening only after that byte, so if new process fails, old one keeps serving.
+  // calls are blocking, new process uses them before loop is run, old one for few bytes on fresh connection.
+  // not supported on windows, all calls fail there.
+  namespace handoff {
+    /** @brief connects to old process, -1 if nobody listens on path. */
+    int connect(const std::string& path);
+
+    /** @brief sends fds, which stay open in this process. */
+    bool send(int socket, const std::vector<int>& fds);
+
+    /** @brief received fds are owned by caller, empty on error. */
+    std::vector<int> receive(int socket);
+
+    /** @brief tells old process that sockets are listened on, closes socket. */
+    void confirm(int socket);
+
+    void close(int fd);
+
+    /** @brief inode of socket file at path, 0 if there is none. */
+    uint64_t inode(const std::string& path);
+
+    /** @brief removes socket file only if it's still the one with inode, new process could have bound its own there. */
+    void unlink(const std::string& path, uint64_t inode);
+  } // namespace handoff
+
+  //---------------------------------------------------------------
+} // namespace http
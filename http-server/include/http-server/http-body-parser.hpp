@@ -37,7 +37,7 @@ namespace http {
 
   public:
     void                      add_buffer(const char* at, size_t length) { buffer_ += std::string_view{ at, length }; }
-    std::unique_ptr<HttpBody> parse(const std::string& content_type);
+    std::unique_ptr<HttpBody> parse(std::string_view content_type);
   };
 
   //---------------------------------------------------------------
@@ -74,11 +74,27 @@ namespace http {
   /** @brief returns message in format "{Status Code Number} {Status Code Description}" */
   const char* http_status_code_message(HttpStatusCode code);
 
+  /** @brief returns preformatted "HTTP/1.1 {Status Code Number} {Status Code Description}\r\n" */
+  std::string_view http_status_line(HttpStatusCode code);
+
+  /** @brief returns preformatted "Date: ...\r\nServer: ...\r\n", regenerated once per second on each thread */
+  std::string_view http_date_headers();
+
+  /** @brief returns "Connection: keep-alive\r\n" or "Connection: close\r\n". */
+  std::string_view http_connection_header(bool keep_alive);
+
+  /** @brief formats time as IMF-fixdate: "Sun, 06 Nov 1994 08:49:37 GMT" */
+  std::string http_date(std::time_t time);
+
+  /** @brief true if If-None-Match value lists etag or is "*", weak tags are compared by value. */
+  bool etag_matches(std::string_view if_none_match, std::string_view etag);
+
   //---------------------------------------------------------------
 
   struct HttpRequestHeaderKey {
     static constexpr std::string_view Authorization   = "Authorization";
     static constexpr std::string_view Accept          = "Accept";
+    static constexpr std::string_view AcceptEncoding  = "Accept-Encoding";
     static constexpr std::string_view Connection      = "Connection";
     static constexpr std::string_view CacheControl    = "Cache-Control";
     static constexpr std::string_view ContentEncoding = "Content-Encoding";
@@ -87,7 +103,11 @@ namespace http {
     static constexpr std::string_view Cookie          = "Cookie";
     static constexpr std::string_view Forwarded       = "Forwarded";
     static constexpr std::string_view Host            = "Host";
+    static constexpr std::string_view IfModifiedSince = "If-Modified-Since";
+    static constexpr std::string_view IfNoneMatch     = "If-None-Match";
+    static constexpr std::string_view IfRange         = "If-Range";
     static constexpr std::string_view Origin          = "Origin";
+    static constexpr std::string_view Range           = "Range";
     static constexpr std::string_view Referer         = "Referer";
     static constexpr std::string_view UserAgent       = "User-Agent";
   };
@@ -95,17 +115,25 @@ namespace http {
   //---------------------------------------------------------------
 
   struct HttpResponseHeaderKey {
+    static constexpr std::string_view AcceptRanges       = "Accept-Ranges";
     static constexpr std::string_view Allow              = "Allow";
     static constexpr std::string_view CacheControl       = "Cache-Control";
     static constexpr std::string_view Connection         = "Connection";
     static constexpr std::string_view ContentDisposition = "Content-Disposition";
     static constexpr std::string_view ContentEncoding    = "Content-Encoding";
     static constexpr std::string_view ContentLength      = "Content-Length";
+    static constexpr std::string_view ContentRange       = "Content-Range";
     static constexpr std::string_view ContentType        = "Content-Type";
+    static constexpr std::string_view Date               = "Date";
+    static constexpr std::string_view ETag               = "ETag";
     static constexpr std::string_view Expires            = "Expires";
+    static constexpr std::string_view LastModified       = "Last-Modified";
     static constexpr std::string_view Location           = "Location";
+    static constexpr std::string_view RetryAfter         = "Retry-After";
     static constexpr std::string_view Server             = "Server";
     static constexpr std::string_view SetCookie          = "Set-Cookie";
+    static constexpr std::string_view TransferEncoding   = "Transfer-Encoding";
+    static constexpr std::string_view Vary               = "Vary";
     static constexpr std::string_view WWWAuthenticate    = "WWW-Authenticate";
   };
 
@@ -118,14 +146,20 @@ namespace http {
     static constexpr std::string_view application_x_www_form_urlencoded = "application/x-www-form-urlencoded";
     static constexpr std::string_view application_xml                   = "application/xml";
     static constexpr std::string_view application_zip                   = "application/zip";
+    static constexpr std::string_view application_octet_stream          = "application/octet-stream";
+    static constexpr std::string_view application_wasm                  = "application/wasm";
     static constexpr std::string_view audio_mpeg                        = "audio/mpeg";
     static constexpr std::string_view audio_ogg                         = "audio/ogg";
+    static constexpr std::string_view font_woff                         = "font/woff";
+    static constexpr std::string_view font_woff2                        = "font/woff2";
     static constexpr std::string_view image_gif                         = "image/gif";
     static constexpr std::string_view image_apng                        = "image/apng";
     static constexpr std::string_view image_flif                        = "image/flif";
     static constexpr std::string_view image_webp                        = "image/webp";
     static constexpr std::string_view image_jpeg                        = "image/jpeg";
     static constexpr std::string_view image_png                         = "image/png";
+    static constexpr std::string_view image_svg_xml                     = "image/svg+xml";
+    static constexpr std::string_view image_x_icon                      = "image/x-icon";
     static constexpr std::string_view multipart_form_data               = "multipart/form-data";
     static constexpr std::string_view text_css                          = "text/css";
     static constexpr std::string_view text_csv                          = "text/csv";
@@ -133,6 +167,8 @@ namespace http {
     static constexpr std::string_view text_php                          = "text/php";
     static constexpr std::string_view text_plain                        = "text/plain";
     static constexpr std::string_view text_xml                          = "text/xml";
+    static constexpr std::string_view video_mp4                         = "video/mp4";
+    static constexpr std::string_view video_webm                        = "video/webm";
 
     inline static std::string combine(std::string_view type, std::string_view param) {
       std::string result{ type };
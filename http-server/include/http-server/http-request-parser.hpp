@@ -1,30 +1,62 @@
 #pragma once
 #include "http-server/pch.hpp"
 #include "http-server/http-body-parser.hpp"
+#include "http-server/arena.hpp"
+#include "http-server/utils.hpp"
 
 namespace http {
   //---------------------------------------------------------------
 
-  using HeadersMap = std::unordered_multimap<std::string, std::string>;
+  // looked up by std::string_view, names are case insensitive. strings and nodes are allocated in arena of request
+  using HeadersMap = std::pmr::unordered_multimap<std::pmr::string, std::pmr::string, StringCaseHash, StringCaseEqual>;
 
-  enum class HttpMethod {
-    GET,
-    POST
-  };
+#define mHttpMethodUnwrap(num, Name, string) Name = num,
+#define mHttpMethodCount(num, Name, string)  +1
+
+  // values are llhttp method numbers, so parser result is converted directly
+  enum class HttpMethod : uint8_t { HTTP_METHOD_MAP(mHttpMethodUnwrap) };
+
+  static constexpr size_t http_methods_count{ 0 HTTP_METHOD_MAP(mHttpMethodCount) };
+
+#undef mHttpMethodCount
+#undef mHttpMethodUnwrap
+
+  inline std::string_view to_string(HttpMethod method) {
+    return llhttp_method_name(static_cast<llhttp_method_t>(method));
+  }
 
   struct HttpRequest {
-    std::string               url;
-    std::smatch               url_matches;
-    HttpMethod                method;
-    HeadersMap                headers;
+    Arena::Ptr                arena{ nullptr }; // first, so it outlives memory allocated in it
+    std::pmr::string          url{};
+    HttpMethod                method{ HttpMethod::GET };
+    HeadersMap                headers{};
     std::unique_ptr<HttpBody> body{ nullptr };
+    bool                      keep_alive{ false }; // client allows connection reuse
+
+    HttpRequest() = default;
+
+    /** @brief url and headers are allocated in arena, which is recycled with request. */
+    explicit HttpRequest(Arena::Ptr arena);
+
+    HttpRequest(HttpRequest&&) noexcept = default;
+
+    /** @brief request is replaced with other one together with its arena, memory isn't copied. */
+    HttpRequest& operator=(HttpRequest&& other) noexcept;
+
+    /** @brief url without query string. */
+    [[nodiscard]] std::string_view path() const {
+      std::string_view result{ url };
+      return result.substr(0, result.find('?'));
+    }
   };
 
   //---------------------------------------------------------------
 
   struct HttpRequestParser {
-    bool           done_{ false }; // after done it could be deleted
-    HttpRequest    request_{};
+    bool           done_{ false };         // after done it could be deleted
+    bool           started_{ false };      // first byte of request is parsed
+    bool           headers_done_{ false }; // body is being parsed
+    HttpRequest    request_;
     llhttp_t       parser{};
     std::string    last_header_field_{};
     std::string    last_header_value_{};
@@ -33,7 +65,15 @@ namespace http {
     HttpRequestParser();
     ~HttpRequestParser();
 
-    bool handle(char* data, size_t size);
+    /**
+     * @brief parses data until request is complete, returns false on parse error.
+     * consumed is count of bytes which were parsed, rest of data belongs to next (pipelined) request
+     * and should be passed after reset().
+     */
+    bool handle(const char* data, size_t size, size_t& consumed);
+
+    /** @brief prepares parser for next request on the same connection. */
+    void reset();
   };
 
   //---------------------------------------------------------------
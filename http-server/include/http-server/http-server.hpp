@@ -3,28 +3,58 @@
 #include "http-server/tcp-server.hpp"
 #include "http-server/http-request-parser.hpp"
 #include "http-server/http-info.hpp"
+#include "http-server/http-stream.hpp"
+#include "http-server/cancellation.hpp"
+#include "http-server/coroutine.hpp"
+#include "http-server/route.hpp"
+#include "http-server/response-cache.hpp"
+#include "http-server/admission.hpp"
+#include "http-server/rate-limit.hpp"
+#include "http-server/scheduler.hpp"
 #include "http-server/utils.hpp"
 
-struct HttpTcpReader;
-
 namespace http {
+  struct HttpConnection;
+  struct StaticFilesSettings;
+  class StaticFiles;
+
   //---------------------------------------------------------------
   // response builder
   struct HttpResponse {
   private:
-    HttpStatusCode                     status_{ HttpStatusCode::InternalServerError };
-    std::stringstream                  message_{};
-    std::map<std::string, std::string> headers_{};
-    bool                               has_message_{ false };
+    // headers which are added by write(...) unless set by user
+    enum DefaultHeader : uint8_t {
+      HasContentType      = 1 << 0,
+      HasConnection       = 1 << 1,
+      HasTransferEncoding = 1 << 2,
+      HasContentLength    = 1 << 3, // set by user for HEAD responses without message
+      HasContentEncoding  = 1 << 4, // body is already encoded by user
+    };
+
+    HttpStatusCode                      status_{ HttpStatusCode::InternalServerError };
+    std::stringstream                   message_{};
+    std::string                         headers_{}; // preformatted "Key: Value\r\n" lines
+    uint8_t                             default_headers_{ 0 };
+    bool                                has_message_{ false };
+    std::shared_ptr<HttpResponseStream> stream_{};
+    std::shared_ptr<HttpResponseSender> sender_{};
 
     friend class HttpServer;
 
-    void write(ITcpWriter* writer);
+    // deletes writer or passes it to stream or sender.
+    // returns true if response could be shared by clients, then it's serialized to cached
+    bool write(HttpResponseWriter* writer, CachedResponse* cached = nullptr);
+    bool capture(std::string& head, const std::string& body, CachedResponse& cached) const;
 
   public:
-    HttpResponse& header(std::string key, std::string value);
+    HttpResponse& header(std::string_view key, std::string_view value); // Date and Server are always added
     HttpResponse& status(HttpStatusCode code);
     HttpResponse& with_default_status_message(); // requires status(...) call before
+    HttpResponse& stream(std::shared_ptr<HttpResponseStream> stream); // body is written by stream in chunks
+    HttpResponse& send(std::shared_ptr<HttpResponseSender> sender);   // body of known length, never compressed
+
+    /** @brief returns value of first header with that key, case insensitive. */
+    [[nodiscard]] std::optional<std::string_view> find_header(std::string_view key) const;
 
     template <typename T>
     HttpResponse& operator<<(T&& data) {
@@ -34,12 +64,33 @@ namespace http {
     }
   };
 
+  //---------------------------------------------------------------
+
+  enum class NetworkBackend : uint8_t {
+    Libuv,   // TcpServer
+    IoUring, // UringServer, needs HTTP_SERVER_IO_URING build option and linux 6.0+, else libuv is used
+  };
+
+  //---------------------------------------------------------------
+  // zero disables timeout
+  struct ConnectionSettings {
+    size_t               max_connections{ 0 }; // accepting is paused while there are that many, 0 is unlimited
+    std::chrono::seconds idle_timeout{ 60 };   // keep-alive connection without request is closed
+    std::chrono::seconds header_timeout{ 10 }; // request head should be received in time since its first byte, else 408
+    std::chrono::seconds body_timeout{ 30 };   // same for body since end of head
+    std::chrono::seconds write_timeout{ 30 };  // connection is dropped if client doesn't read response for that long
+    bool                 no_delay{ true };     // TCP_NODELAY, response is sent in one write per loop iteration anyway
+    bool                 cork{ false };        // socket is corked while response is written, e.g. for streamed bodies
+  };
+
   //---------------------------------------------------------------
   // base class for users
   struct HttpRequestHandler {
     using HandleResult = cti::continuable<http::HttpResponse>;
 
-    HttpRequest request{};
+    HttpRequest       request{};
+    CancellationToken cancellation{};           // cancelled when client disconnects, pass it to db calls
+    bool              allow_compression{ true }; // per route: `static inline bool compression = false;` in handler
 
     HttpRequestHandler() = default;
 
@@ -47,11 +98,18 @@ namespace http {
     virtual bool         preprocess() { return true; }
     virtual HandleResult handle() = 0;
     void                 destroy();
+  };
 
-    template <typename... TArgs>
-    bool unwrap_url(TArgs&&... args) {
-      return url::unwrap(request.url_matches, std::forward<TArgs>(args)...);
-    }
+  //---------------------------------------------------------------
+  // base class for users who prefer coroutines:
+  // handle_async() can co_await db.query(...), tarantool calls and http::sleep(...)
+  struct HttpCoroutineHandler : public HttpRequestHandler {
+    using AsyncResult = Task<http::HttpResponse>;
+
+    ~HttpCoroutineHandler() override = default;
+
+    virtual AsyncResult handle_async() = 0;
+    HandleResult        handle() final;
   };
 
   //---------------------------------------------------------------
@@ -59,30 +117,113 @@ namespace http {
   class HttpServer {
     using RequestHandlerFactory = std::function<HttpRequestHandler*()>; // TODO should not be unique ptr?
 
+    // returns nullptr if route doesn't match, otherwise takes request and fills handler params
+    using RouteHandlerFactory = std::function<HttpRequestHandler*(HttpRequest& request)>;
+
     struct Handler {
-      HttpMethod            method;
-      std::regex            url_match;
-      RequestHandlerFactory construct;
+      bool (*matches)(std::string_view path);
+      RouteHandlerFactory        construct;
+      bool                       allow_compression{ true };
+      const ResponseCachePolicy* cache{ nullptr };   // THandler::cache if declared
+      bool                       coalesce{ false };  // THandler::coalesce, by default true for cached routes
+      size_t                     max_in_flight{ 0 }; // THandler::max_in_flight, requests above it get 429
+      size_t                     in_flight{ 0 };
     };
 
-    using HttpHandlers = std::vector<Handler>; // TODO: regex-tree?
+    // waits for response of identical request which is in flight
+    struct CoalescedRequest {
+      HttpRequest         request;
+      HttpResponseWriter* writer;
+      CancellationToken   cancellation;
+    };
+
+    using CoalescedRequests = std::unordered_map<std::string, std::vector<CoalescedRequest>>; // by response key
 
-    HttpHandlers          handlers_{};
-    RequestHandlerFactory make_not_found_handler_;
-    RequestHandlerFactory make_bad_request_handler_;
-    TcpServer             tcp_;
+    using HttpHandlers  = std::array<std::vector<Handler>, http_methods_count>; // indexed by method
+    using SignalHandles = std::vector<std::shared_ptr<uvw::SignalHandle>>;
 
-    static std::regex preprocess_regex(const std::string& str);
+    HttpHandlers                              handlers_{};
+    RequestHandlerFactory                     make_not_found_handler_;
+    RequestHandlerFactory                     make_bad_request_handler_;
+    CompressionSettings                       compression_{};
+    std::unique_ptr<ResponseCache>            response_cache_{};
+    CoalescedRequests                         coalesced_{};
+    AdmissionControl                          admission_{};
+    std::unique_ptr<RateLimiter>              rate_limiter_{};
+    ConnectionSettings                        connection_settings_{};
+    std::unordered_set<HttpConnection*>       connections_{};
+    bool                                      draining_{ false }; // shutdown is in progress
+    Scheduler::Timer                          shutdown_deadline_{ [this] { drop_connections(); } };
+    std::function<void()>                     on_shutdown_{};
+    SignalHandles                             signals_{};
+    std::shared_ptr<uvw::PipeHandle>          handoff_{};
+    uint64_t                                  handoff_inode_{ 0 }; // of socket file bound by this process
+    std::vector<std::shared_ptr<StaticFiles>> static_files_{};
+    std::unique_ptr<ITcpServer>               tcp_;
 
   public:
-    HttpServer();
+    explicit HttpServer(NetworkBackend backend = NetworkBackend::Libuv);
 
+    /**
+     * @brief THandler declares `using Route = http::Route<"/path/{int}">;`,
+     * and `Route::Params params;` member if route has placeholders.
+     * optional statics: `compression` (bool), `cache` (ResponseCachePolicy) and
+     * `coalesce` (bool): concurrent identical GET requests share one handler call, requests are
+     * identical by url and `cache.vary` headers (cache without ttl only declares them), requests with
+     * Cookie are not coalesced unless Cookie is in `cache.vary`,
+     * `max_in_flight` (size_t): requests above that many running handlers of route get 429.
+     */
     template <typename THandler>
     void add_handler() {
-      handlers_.emplace_back(Handler{
-          .method    = THandler::method,
-          .url_match = preprocess_regex(THandler::path),
-          .construct = [] { return new THandler(); },
+      add_handler<THandler>([](THandler&) {});
+    }
+
+    /** @brief same as add_handler(), init(handler) is called for every constructed handler, e.g. to bind state of this server. */
+    template <typename THandler, typename TInit>
+    void add_handler(TInit init) {
+      handlers_[static_cast<size_t>(THandler::method)].emplace_back(Handler{
+          .matches   = [](std::string_view path) { return THandler::Route::match(path); },
+          .construct = [init = std::move(init)](HttpRequest& request) -> HttpRequestHandler* {
+            using TRoute = typename THandler::Route;
+            if (!TRoute::match(request.path())) {
+              return nullptr;
+            }
+            auto handler     = new THandler();
+            handler->request = std::move(request);
+            init(*handler);
+            if constexpr (requires { THandler::compression; }) {
+              handler->allow_compression = THandler::compression;
+            }
+            if constexpr (std::tuple_size_v<typename TRoute::Params> != 0) {
+              // parsed again: string params should view into handler's own url
+              TRoute::match(handler->request.path(), handler->params);
+            }
+            return handler;
+          },
+          .allow_compression = [] {
+            if constexpr (requires { THandler::compression; }) {
+              return static_cast<bool>(THandler::compression);
+            }
+            return true;
+          }(),
+          .cache = [] {
+            if constexpr (requires { THandler::cache; }) {
+              return static_cast<const ResponseCachePolicy*>(&THandler::cache);
+            }
+            return static_cast<const ResponseCachePolicy*>(nullptr);
+          }(),
+          .coalesce = [] {
+            if constexpr (requires { THandler::coalesce; }) {
+              return static_cast<bool>(THandler::coalesce);
+            }
+            return requires { THandler::cache; };
+          }(),
+          .max_in_flight = [] {
+            if constexpr (requires { THandler::max_in_flight; }) {
+              return static_cast<size_t>(THandler::max_in_flight);
+            }
+            return size_t{ 0 };
+          }(),
       });
     }
 
@@ -100,13 +241,90 @@ namespace http {
       };
     }
 
+    /** @brief limits count of connections and time which client could hold one without progress. */
+    void set_connection_settings(ConnectionSettings settings);
+
+    /** @brief responses are compressed with encoding from Accept-Encoding if settings.enabled. */
+    void set_compression(CompressionSettings settings) { compression_ = settings; }
+
+    /**
+     * @brief GET responses of routes with `cache` policy are stored serialized
+     * and written for matching requests without constructing handler.
+     */
+    void set_response_cache(ResponseCacheSettings settings) { response_cache_ = std::make_unique<ResponseCache>(settings); }
+
+    /**
+     * @brief requests above limit of running handlers are answered with 503 and Retry-After
+     * without constructing handler, requests above `max_in_flight` of their route get 429.
+     * cache hits and coalesced requests are not counted.
+     */
+    void set_admission(AdmissionSettings settings) { admission_.configure(settings); }
+
+    /**
+     * @brief requests of client above settings.rate are answered with 429 and Retry-After
+     * right after parsing, without looking up handler. disabled if rate is zero.
+     */
+    void set_rate_limit(RateLimitSettings settings);
+
+    /**
+     * @brief serves files from settings.root for GET and HEAD requests on Path,
+     * which should end with "/{path}": add_static_files<"/static/{path}">({ .root = "public" }).
+     * defined in http-server/static-files.hpp.
+     */
+    template <FixedString Path>
+    void add_static_files(StaticFilesSettings settings);
+
     void listen(const char* addr, int port);
 
+    /**
+     * @brief unix socket, for proxy on the same host. name starting with '@' is in linux abstract namespace.
+     * clients have no address, so rate limit should be keyed by header.
+     */
+    void listen_unix(const std::string& path);
+
+    /**
+     * @brief hot restart, new process: listens on socket of old process which called serve_handoff(path).
+     * returns false if there is nobody to take it from, then listen(addr, port) should be used.
+     * should be called before run_main_loop(), it blocks until socket is received.
+     */
+    bool listen_handoff(const std::string& path);
+
+    /**
+     * @brief hot restart, old process: listening socket is given to new process which connects to path,
+     * then this server shuts down as with shutdown(deadline, on_done).
+     */
+    void serve_handoff(const std::string& path, std::chrono::milliseconds deadline, std::function<void()> on_done = {});
+
+    /**
+     * @brief stops accepting and closes idle connections, in-flight responses are finished with
+     * `Connection: close`. connections left after deadline are dropped, their handlers are cancelled.
+     * on_done is called when no connection is left, close db clients there to let run_main_loop() return.
+     */
+    void shutdown(std::chrono::milliseconds deadline, std::function<void()> on_done = {});
+
+    /** @brief SIGTERM and SIGINT start shutdown, repeated signal drops connections right away. */
+    void shutdown_on_signals(std::chrono::milliseconds deadline, std::function<void()> on_done = {});
+
   private:
-    friend struct ::HttpTcpReader;
+    friend struct HttpConnection;
+
+    Handler*    find_handler(HttpMethod method, std::string_view path);
+    std::string allowed_methods(std::string_view path) const; // empty if no route matches path
+    void        negotiate_compression(HttpResponseWriter& writer, const HttpRequest& request, bool allow_compression) const;
+
+    bool _limit_rate(const HttpRequest& request, const std::string& peer, HttpResponseWriter* writer); // true if answered
+    void _handle_request(HttpRequest request, HttpResponseWriter* writer, CancellationToken cancellation, bool coalesce = true);
+    void complete_request(HttpResponse& response, HttpResponseWriter* writer, const std::string& key,
+                          const ResponseCachePolicy* cache_policy, bool coalesce);
+    void _handle_request_parse_error(HttpResponseWriter* writer);
+    void _handle_request_timeout(HttpResponseWriter* writer);
+    void release_admission(Handler* handler, AdmissionControl::Clock::time_point admitted_at);
+    void remove_connection(HttpConnection* connection);
+    void drop_connections();
+    void finish_shutdown();
 
-    void _handle_request(HttpRequest request, ITcpWriter* writer);
-    void _handle_request_parse_error(ITcpWriter* writer);
+    // written without handler, so overload costs as little as possible
+    static void write_overloaded(HttpResponseWriter* writer, HttpStatusCode status, std::chrono::seconds retry_after);
   };
 
   //---------------------------------------------------------------
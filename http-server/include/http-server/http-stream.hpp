@@ -0,0 +1,73 @@
+#pragma once
+#include "http-server/pch.hpp"
+#include "http-server/tcp-server.hpp"
+#include "http-server/compression.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+  // writer of one response. done() finishes response: connection is reused
+  // for next request if keep_alive is still set, otherwise it's closed.
+  struct HttpResponseWriter : public ITcpWriter {
+    bool                       keep_alive{ false };
+    bool                       with_body{ true }; // false for HEAD requests
+    ContentEncoding            encoding{ ContentEncoding::Identity }; // accepted by client and allowed by route
+    const CompressionSettings* compression{ nullptr };                // set if encoding is not identity
+
+    // cb is called once if connection is closed before response is done, e.g. client has gone
+    virtual void on_close(std::function<void()> /*cb*/) {}
+
+    // body bytes not sent yet by sender which writes around write queue, so write timeout sees its progress
+    virtual void outstanding(size_t /*bytes*/) {}
+  };
+
+  //---------------------------------------------------------------
+  // writes body of response with chunked transfer encoding.
+  // owns writer: response is finished by end() or abort() (or destructor).
+  // chunks are compressed if compressor is given.
+  class HttpChunkWriter {
+    HttpResponseWriter* writer_;
+    CompressorHandle    compressor_;
+    std::string         compressed_{};
+
+  public:
+    explicit HttpChunkWriter(HttpResponseWriter* writer, CompressorHandle compressor = {})
+        : writer_{ writer }
+        , compressor_{ std::move(compressor) } {}
+
+    HttpChunkWriter(const HttpChunkWriter&) = delete;
+    HttpChunkWriter& operator=(const HttpChunkWriter&) = delete;
+
+    ~HttpChunkWriter();
+
+    void write(std::string_view chunk); // empty chunk is skipped, it's reserved for end()
+    void end();                         // writes terminating chunk and finishes response
+    void abort();                       // closes connection without terminating chunk
+
+    [[nodiscard]] size_t pending() const { return writer_ ? writer_->pending() : 0; }
+    [[nodiscard]] bool   closed() const { return !writer_ || writer_->closed(); }
+    void                 on_drain(std::function<void()> cb);
+    void                 on_close(std::function<void()> cb); // see HttpResponseWriter::on_close
+  };
+
+  //---------------------------------------------------------------
+  // body producer for responses which are written while data arrives.
+  // start is called on loop thread right after response headers are written.
+  struct HttpResponseStream {
+    virtual ~HttpResponseStream()                               = default;
+    virtual void start(std::unique_ptr<HttpChunkWriter> writer) = 0;
+  };
+
+  //---------------------------------------------------------------
+  // body of known length which is written by its own means, bypassing
+  // response data stream (e.g. sendfile). start is called on loop thread
+  // after response headers are flushed. sender finishes response with writer->done(),
+  // keep_alive should be cleared if body is not written completely.
+  // sender reports bytes left with writer->outstanding() while it is sending.
+  struct HttpResponseSender {
+    virtual ~HttpResponseSender()                                                  = default;
+    [[nodiscard]] virtual size_t length() const                                    = 0;
+    virtual void                 start(std::unique_ptr<HttpResponseWriter> writer) = 0;
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
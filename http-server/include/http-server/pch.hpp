@@ -15,6 +15,7 @@
 #include <uvw.hpp>
 #include <ulid.h>
 #include <msgpack.hpp>
+#include <zlib.h>
 
 #ifdef _MSC_VER
   #pragma warning(pop)
@@ -23,17 +24,38 @@
 #include <string_view>
 #include <sstream>
 #include <string>
-#include <regex>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <csignal>
+#include <charconv>
+#include <cmath>
 
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include <array>
+#include <deque>
+#include <list>
 #include <tuple>
 #include <map>
+#include <any>
+#include <variant>
+#include <optional>
 
 #include <exception>
 #include <functional>
+#include <algorithm>
 #include <utility>
+#include <limits>
+#include <bit>
 
+#include <chrono>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <memory_resource>
+
+#include <coroutine>
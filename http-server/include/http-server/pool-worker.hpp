@@ -2,61 +2,150 @@
 #include "http-server/pch.hpp"
 #include "http-server/error.hpp"
 #include "http-server/pool.hpp"
+#include "http-server/coroutine.hpp"
 
 namespace http {
   //---------------------------------------------------------------
 
   template <typename TResource>
   class PoolWorker {
-    std::unique_ptr<Pool<TResource>> pool_;
+    std::unique_ptr<Pool<TResource>>  pool_;
+    std::shared_ptr<uvw::TimerHandle> reaper_{};
 
     template <typename TUserData>
     struct WorkData {
       using Action = std::function<TUserData(TResource&)>;
 
-      TUserData               user_data{};
-      TResource*              resource{ nullptr };
-      Error                   error{};
-      Action                  action;
-      cti::promise<TUserData> promise;
+      TUserData         user_data{};
+      Error             error{};
+      Action            action;
+      CancellationToken token;
+      bool              resource_dropped{ false }; // broken resource was destroyed, pool is below min_size
 
-      WorkData(Action action, cti::promise<TUserData> promise)
+      WorkData(Action action, CancellationToken token)
           : action{ std::move(action) }
+          , token{ std::move(token) } {}
+
+      virtual ~WorkData()     = default;
+      virtual void complete() = 0; // called on loop thread when action is done
+    };
+
+    template <typename TUserData>
+    struct PromiseWorkData : public WorkData<TUserData> {
+      cti::promise<TUserData> promise;
+
+      PromiseWorkData(typename WorkData<TUserData>::Action action, CancellationToken token, cti::promise<TUserData> promise)
+          : WorkData<TUserData>{ std::move(action), std::move(token) }
           , promise{ std::move(promise) } {}
+
+      void complete() override {
+        if (this->error) {
+          promise.set_exception(std::make_exception_ptr(this->error));
+        } else {
+          promise.set_value(std::move(this->user_data));
+        }
+      }
+    };
+
+    template <typename TUserData>
+    struct CoroutineWorkData : public WorkData<TUserData> {
+      std::coroutine_handle<> handle;
+      TUserData*              result;
+      Error*                  error_result;
+
+      CoroutineWorkData(typename WorkData<TUserData>::Action action, CancellationToken token,
+                        std::coroutine_handle<> handle, TUserData* result, Error* error_result)
+          : WorkData<TUserData>{ std::move(action), std::move(token) }
+          , handle{ handle }
+          , result{ result }
+          , error_result{ error_result } {}
+
+      void complete() override {
+        *result       = std::move(this->user_data);
+        *error_result = std::move(this->error);
+        handle.resume();
+      }
+    };
+
+    // result of with_resource for coroutines: co_await resumes on loop thread
+    template <typename TUserData>
+    class ResourceAwaitable {
+      PoolWorker*                          worker_;
+      typename WorkData<TUserData>::Action action_;
+      CancellationToken                    token_;
+      TUserData                            result_{};
+      Error                                error_{};
+
+    public:
+      ResourceAwaitable(PoolWorker* worker, typename WorkData<TUserData>::Action action, CancellationToken token)
+          : worker_{ worker }
+          , action_{ std::move(action) }
+          , token_{ std::move(token) } {}
+
+      bool await_ready() const noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+        worker_->enqueue_task(new CoroutineWorkData<TUserData>(std::move(action_), std::move(token_), handle, &result_, &error_));
+      }
+
+      TUserData await_resume() {
+        if (error_) {
+          throw error_;
+        }
+        return std::move(result_);
+      }
     };
 
     template <typename TUserData>
     auto work(WorkData<TUserData>* work_data) {
       return [this, work_data]() {
-        work_data->resource = pool_->acquire();
+        auto& token = work_data->token;
+        if (token.cancelled()) {
+          // nobody waits for result, connection is not touched
+          work_data->error = std::move(Error{ token.reason() });
+          return;
+        }
 
-        if (!work_data->resource) {
+        TResource* resource{ nullptr };
+        try {
+          resource = pool_->acquire();
+        } catch (std::exception& ex) {
+          work_data->error = std::move(Error{ ex });
+          return;
+        }
+
+        if (!resource) {
           work_data->error = std::move(Error{ ErrorCode::NoConnectionsInPool });
           g_log->debug("pool busy");
           return;
         }
 
+        auto callback_id = token.on_cancel([this, resource] {
+          pool_->interrupt_resource(*resource);
+        });
+
         try {
-          work_data->user_data = work_data->action(*work_data->resource);
+          pool_->begin_task(*resource, token);
+          work_data->user_data = work_data->action(*resource);
         } catch (std::exception& ex) {
-          work_data->error = std::move(Error{ ex });
+          work_data->error = token.cancelled() ? Error{ token.reason() } : Error{ ex };
         }
+
+        pool_->end_task(*resource);
+        token.remove_on_cancel(callback_id);
+
+        // released on worker thread, so it goes back to this thread's pool shard
+        work_data->resource_dropped = pool_->release(resource);
       };
     }
 
     template <typename TUserData>
     auto work_callback(WorkData<TUserData>* work_data) {
       return [this, work_data](const auto&, auto& handle) {
-        if (work_data->resource) {
-          pool_->release(work_data->resource);
-        }
-
-        if (work_data->error) {
-          work_data->promise.set_exception(std::make_exception_ptr(work_data->error));
-        } else {
-          work_data->promise.set_value(std::move(work_data->user_data));
+        if (work_data->resource_dropped) {
+          queue_maintenance([this] { pool_->add_resource(); }); // not waiting for reaper to keep min_size
         }
-
+        work_data->complete();
         delete work_data;
       };
     }
@@ -69,18 +158,73 @@ namespace http {
       handle->queue();
     }
 
+    void queue_maintenance(std::function<void()> task) {
+      auto loop = uvw::Loop::getDefault();
+      auto handle = loop->resource<uvw::WorkReq>([task = std::move(task)] {
+        try {
+          task();
+        } catch (std::exception& ex) {
+          g_log->error("pool maintenance error: {}", ex.what());
+        }
+      });
+      handle->queue();
+    }
+
   public:
     explicit PoolWorker(std::unique_ptr<Pool<TResource>> pool)
         : pool_{ std::move(pool) } {}
 
+    ~PoolWorker() {
+      if (reaper_) {
+        reaper_->clear(); // callback refers to this
+        reaper_->close();
+      }
+    }
+
+    /**
+     * @brief creates min_size resources in parallel and starts periodic reaping of idle ones.
+     * should be called from loop thread before run_main_loop().
+     */
+    void start() {
+      const auto& settings = pool_->settings();
+
+      for (size_t i = 0; i < settings.min_size; i++) {
+        queue_maintenance([this] { pool_->add_resource(); });
+      }
+
+      auto interval = std::max(settings.idle_timeout / 2, std::chrono::milliseconds{ 1000 });
+      reaper_       = uvw::Loop::getDefault()->resource<uvw::TimerHandle>();
+      reaper_->template on<uvw::TimerEvent>([this](const uvw::TimerEvent&, uvw::TimerHandle&) {
+        queue_maintenance([this] {
+          if (auto reaped = pool_->reap_idle()) {
+            g_log->debug("pool reaped {} idle resources", reaped);
+          }
+          while (pool_->add_resource()) {} // replace broken ones to keep min_size
+        });
+      });
+      reaper_->start(interval, interval);
+      reaper_->unreference(); // reaper alone should not keep loop running
+    }
+
+    /**
+     * @brief runs action with resource in threadpool.
+     * if token is cancelled or its deadline has passed before task is started, task is dropped,
+     * if it's cancelled while action is running, resource is interrupted.
+     * in both cases continuable fails with Error{ token.reason() }.
+     */
     template <typename TUserData>
-    auto with_resource(typename WorkData<TUserData>::Action action) {
+    auto with_resource(typename WorkData<TUserData>::Action action, CancellationToken token = {}) {
       // todo retry on pool busy
-      return cti::make_continuable<TUserData>([action = std::move(action), this](cti::promise<TUserData>&& promise) {
-        auto work_data = new WorkData<TUserData>(action, std::move(promise));
-        enqueue_task(work_data);
+      return cti::make_continuable<TUserData>([action = std::move(action), token = std::move(token), this](cti::promise<TUserData>&& promise) {
+        enqueue_task(new PromiseWorkData<TUserData>(action, token, std::move(promise)));
       });
     }
+
+    /** @brief same as with_resource, but result should be co_await'ed from coroutine. */
+    template <typename TUserData>
+    auto await_resource(typename WorkData<TUserData>::Action action, CancellationToken token = {}) {
+      return ResourceAwaitable<TUserData>{ this, std::move(action), std::move(token) };
+    }
   };
 
   //---------------------------------------------------------------
@@ -1,65 +1,219 @@
 #pragma once
 #include "http-server/pch.hpp"
 #include "http-server/log.hpp"
+#include "http-server/cancellation.hpp"
 
 namespace http {
   //---------------------------------------------------------------
 
+  struct PoolSettings {
+    size_t                    min_size{ 0 };  // created by warm up and kept while idle
+    size_t                    max_size{ 64 };
+    std::chrono::milliseconds idle_timeout{ std::chrono::minutes{ 5 } }; // free resources above min_size are reaped after it
+  };
+
+  //---------------------------------------------------------------
+  // free resources are kept in several shards, each thread starts looking for
+  // free resource in its own shard and steals from others if it's empty.
+  // resources are released on the thread which used them, so in steady state
+  // every worker thread hits only its own shard lock.
   template <typename TResource>
   class Pool {
-    std::mutex              lock_{};
-    std::vector<TResource*> free_pool_{};
-    size_t                  already_taken_{ 0 };
-    size_t                  max_pool_size_;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t shards_count{ 8 };
+
+    struct FreeResource {
+      TResource*        resource;
+      Clock::time_point released_at;
+    };
+
+    struct alignas(64) Shard {
+      std::mutex                lock{};
+      std::vector<FreeResource> free{}; // ordered by release time, oldest first
+    };
+
+    std::array<Shard, shards_count> shards_{};
+    std::atomic<size_t>             already_taken_{ 0 };
+    std::atomic<size_t>             created_{ 0 };
+    PoolSettings                    settings_;
 
   protected:
     virtual TResource* create_resource() = 0;
 
+    /** @brief called on release, broken resource is destroyed and created again by worker if pool is below min_size. */
+    virtual bool validate_resource(TResource&) { return true; }
+
   public:
-    explicit Pool(size_t max_pool_size = 64)
-        : max_pool_size_{ max_pool_size } {
-      free_pool_.reserve(max_pool_size_);
-    }
+    explicit Pool(PoolSettings settings = {})
+        : settings_{ settings } {}
 
     virtual ~Pool() {
-      for (auto* p : free_pool_) {
-        delete p;
+      for (auto& shard : shards_) {
+        for (auto& free : shard.free) {
+          delete free.resource;
+        }
       }
     }
 
+    [[nodiscard]] const PoolSettings& settings() const { return settings_; }
+
+    /** @brief called on worker thread before action, token lives until end_task. */
+    virtual void begin_task(TResource&, const CancellationToken&) {}
+    virtual void end_task(TResource&) {}
+
+    /** @brief called from other thread when token is cancelled while resource is used by action. */
+    virtual void interrupt_resource(TResource&) {}
+
     /**
      * @brief returns resource pointer if succeeded, nullptr otherwise.
      * thread safe.
      * after usage should be released.
      */
     TResource* acquire() {
-      std::unique_lock<std::mutex> _{ lock_ };
-      TResource*                   resource;
+      if (!reserve_slot()) {
+        return nullptr;
+      }
 
-      if (free_pool_.empty()) {
-        if (already_taken_ == max_pool_size_) {
-          return nullptr;
+      // slot is reserved, so some resource is free or could be created
+      while (true) {
+        if (auto* resource = take_free()) {
+          return resource;
         }
-        resource = create_resource();
+
+        if (created_.fetch_add(1, std::memory_order_relaxed) < settings_.max_size) {
+          try {
+            auto* resource = create_resource();
+            g_log->debug("pool created resource");
+            return resource;
+          } catch (...) {
+            created_.fetch_sub(1, std::memory_order_relaxed);
+            already_taken_.fetch_sub(1, std::memory_order_release);
+            throw;
+          }
+        }
+
+        // all resources are created, one is being released right now
+        created_.fetch_sub(1, std::memory_order_relaxed);
+        std::this_thread::yield();
+      }
+    }
+
+    /** @brief returns true if resource was broken and pool has less than min_size resources now. thread safe. */
+    bool release(TResource* resource) {
+      bool valid{ false };
+      try {
+        valid = validate_resource(*resource);
+      } catch (std::exception& ex) {
+        g_log->error("pool resource validation error: {}", ex.what());
+      }
+
+      bool below_min{ false };
+      if (valid) {
+        push_free(resource);
       } else {
-        resource = free_pool_.back();
-        free_pool_.pop_back();
+        g_log->info("pool resource is broken, destroying it");
+        delete resource;
+        below_min = created_.fetch_sub(1, std::memory_order_relaxed) <= settings_.min_size;
+      }
+      already_taken_.fetch_sub(1, std::memory_order_release);
+      return below_min;
+    }
+
+    /**
+     * @brief creates one free resource if there are less than min_size resources.
+     * returns false if there are enough resources. thread safe.
+     */
+    bool add_resource() {
+      size_t created = created_.load(std::memory_order_relaxed);
+      do {
+        if (created >= settings_.min_size) {
+          return false;
+        }
+      } while (!created_.compare_exchange_weak(created, created + 1, std::memory_order_relaxed));
+
+      TResource* resource;
+      try {
+        resource = create_resource();
+      } catch (...) {
+        created_.fetch_sub(1, std::memory_order_relaxed);
+        throw;
       }
+      push_free(resource);
+      return true;
+    }
 
-      already_taken_++;
-      g_log->debug("pool already_taken_: {}", already_taken_);
+    /**
+     * @brief destroys free resources which were idle longer than idle_timeout,
+     * keeping at least min_size resources. returns count of destroyed resources. thread safe.
+     */
+    size_t reap_idle() {
+      auto                    idle_since = Clock::now() - settings_.idle_timeout;
+      std::vector<TResource*> reaped;
+
+      for (auto& shard : shards_) {
+        std::unique_lock<std::mutex> _{ shard.lock };
+        auto&                        free = shard.free;
+        size_t                       count{ 0 };
+        while (count < free.size() && free[count].released_at < idle_since && try_retire()) {
+          reaped.push_back(free[count].resource);
+          count++;
+        }
+        free.erase(free.begin(), free.begin() + static_cast<ptrdiff_t>(count));
+      }
 
-      return resource;
+      for (auto* resource : reaped) {
+        delete resource;
+      }
+      return reaped.size();
+    }
+
+  private:
+    bool reserve_slot() {
+      size_t taken = already_taken_.load(std::memory_order_relaxed);
+      do {
+        if (taken >= settings_.max_size) {
+          return false;
+        }
+      } while (!already_taken_.compare_exchange_weak(taken, taken + 1, std::memory_order_acquire));
+      return true;
+    }
+
+    TResource* take_free() {
+      size_t home = shard_index();
+      for (size_t i = 0; i < shards_count; i++) {
+        auto&                        shard = shards_[(home + i) % shards_count];
+        std::unique_lock<std::mutex> _{ shard.lock };
+        if (!shard.free.empty()) {
+          auto* resource = shard.free.back().resource;
+          shard.free.pop_back();
+          return resource;
+        }
+      }
+      return nullptr;
+    }
+
+    void push_free(TResource* resource) {
+      auto&                        shard = shards_[shard_index()];
+      std::unique_lock<std::mutex> _{ shard.lock };
+      shard.free.push_back(FreeResource{ resource, Clock::now() });
+    }
+
+    bool try_retire() {
+      size_t created = created_.load(std::memory_order_relaxed);
+      do {
+        if (created <= settings_.min_size) {
+          return false;
+        }
+      } while (!created_.compare_exchange_weak(created, created - 1, std::memory_order_relaxed));
+      return true;
     }
 
-    /** @brief thread safe. */
-    void release(TResource* resource) {
-      std::unique_lock<std::mutex> _{ lock_ };
-      free_pool_.push_back(resource);
-      already_taken_--;
-      g_log->debug("pool already_taken_: {}", already_taken_);
+    static size_t shard_index() {
+      static thread_local const size_t index = std::hash<std::thread::id>{}(std::this_thread::get_id()) % shards_count;
+      return index;
     }
   };
 
   //---------------------------------------------------------------
-} // namespace http
\ No newline at end of file
+} // namespace http
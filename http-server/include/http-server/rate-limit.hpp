@@ -0,0 +1,60 @@
+#pragma once
+#include "http-server/pch.hpp"
+#include "http-server/utils.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+
+  struct RateLimitSettings {
+    double                    rate{ 0 };              // requests per second per client, 0 disables limiter
+    double                    burst{ 20 };            // requests client can make at once after being idle
+    std::string               key_header{};           // e.g. "Authorization", peer address is used if empty or missing
+    std::chrono::milliseconds sweep_interval{ 1000 }; // one shard is swept per interval
+  };
+
+  //---------------------------------------------------------------
+  // token bucket per client. buckets are refilled lazily on access, bucket which
+  // stayed idle long enough to become full again is same as missing one, so it's evicted.
+  // used on loop thread only.
+  class RateLimiter {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+  private:
+    static constexpr size_t shards_count{ 16 };
+
+    struct Bucket {
+      float    tokens;
+      uint32_t updated_ms; // since start_
+    };
+
+    using Shard = std::unordered_map<std::string, Bucket, StringHash, StringEqual>;
+
+    RateLimitSettings                 settings_;
+    Clock::time_point                 start_{ Clock::now() };
+    std::array<Shard, shards_count>   shards_{};
+    size_t                            next_sweep_{ 0 };
+    std::shared_ptr<uvw::TimerHandle> sweeper_{};
+
+  public:
+    explicit RateLimiter(RateLimitSettings settings);
+    ~RateLimiter();
+
+    RateLimiter(const RateLimiter&)            = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    [[nodiscard]] const RateLimitSettings& settings() const { return settings_; }
+
+    /** @brief takes token of client, if there is none returns false and time until next one in retry_after. */
+    bool try_acquire(std::string_view key, std::chrono::seconds& retry_after);
+
+    /** @brief drops idle buckets of one shard, returns number of dropped ones. */
+    size_t sweep();
+
+  private:
+    [[nodiscard]] uint32_t now_ms() const;
+    [[nodiscard]] uint32_t idle_ms() const; // time to refill empty bucket
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
@@ -0,0 +1,74 @@
+#pragma once
+#include "http-server/pch.hpp"
+#include "http-server/http-info.hpp"
+#include "http-server/http-request-parser.hpp"
+#include "http-server/http-stream.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+  // per route: `static inline http::ResponseCachePolicy cache{ .ttl = std::chrono::seconds{ 10 } };` in handler.
+  // policy without ttl only declares vary headers for coalescing of identical requests.
+  struct ResponseCachePolicy {
+    std::chrono::milliseconds ttl{ 0 }; // responses are not cached if zero
+    std::vector<std::string>  vary{};   // request headers which select response, sent as Vary
+
+    [[nodiscard]] bool varies(std::string_view header) const {
+      return std::any_of(vary.begin(), vary.end(), [header](const std::string& name) { return iequals(name, header); });
+    }
+  };
+
+  struct ResponseCacheSettings {
+    size_t max_size{ 64 * 1024 * 1024 }; // bytes of keys, headers and bodies
+    size_t max_entry_size{ 1024 * 1024 };
+  };
+
+  //---------------------------------------------------------------
+  // serialized response, written for hits as is, only Date and Connection are added
+  struct CachedResponse {
+    using Clock = std::chrono::steady_clock;
+
+    HttpStatusCode    status{ HttpStatusCode::OK };
+    std::string       head{}; // "Key: Value\r\n" lines, includes Content-Length and ETag
+    std::string       body{};
+    std::string       etag{};
+    std::string       vary{}; // "Vary: ...\r\n" lines, repeated in 304 responses
+    Clock::time_point expires_at{};
+
+    [[nodiscard]] size_t size() const { return head.size() + body.size() + etag.size() + vary.size(); }
+
+    /** @brief writes whole response or 304 if not_modified, deletes writer. */
+    void write(HttpResponseWriter* writer, bool not_modified) const;
+  };
+
+  //---------------------------------------------------------------
+  // size bounded LRU of responses by method, url, negotiated encoding and vary headers.
+  // expired entries are dropped on lookup. used on loop thread only.
+  class ResponseCache {
+    struct Entry {
+      CachedResponse                   response;
+      std::list<std::string>::iterator lru;
+    };
+
+    ResponseCacheSettings                  settings_;
+    std::unordered_map<std::string, Entry> entries_{};
+    std::list<std::string>                 lru_{}; // most recently used first
+    size_t                                 size_{ 0 };
+
+  public:
+    explicit ResponseCache(ResponseCacheSettings settings)
+        : settings_{ settings } {}
+
+    /** @brief empty key if request can't be served from cache. */
+    static std::string make_key(const HttpRequest& request, const ResponseCachePolicy& policy, ContentEncoding encoding);
+
+    /** @brief returns nullptr if there is no fresh entry, pointer is valid until next insert. */
+    const CachedResponse* find(const std::string& key);
+
+    void insert(const std::string& key, CachedResponse response);
+
+  private:
+    void erase(const std::string& key);
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
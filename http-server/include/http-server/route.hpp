@@ -0,0 +1,216 @@
+#pragma once
+#include "http-server/pch.hpp"
+#include "http-server/ulid.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+  // string literal usable as template argument: Route<"/api/part/{int}/{string}">
+  template <size_t N>
+  struct FixedString {
+    char data[N]{};
+
+    constexpr FixedString(const char (&str)[N]) { std::copy_n(str, N, data); }
+
+    [[nodiscard]] constexpr std::string_view view() const { return { data, N - 1 }; }
+  };
+
+  //---------------------------------------------------------------
+
+  namespace detail {
+    enum class RouteSegmentKind {
+      Literal,
+      Int,    // {int}
+      Int64,  // {int64}
+      String, // {string}, non empty
+      Ulid,   // {ulid}
+      Tail,   // {path}, rest of path with slashes, possibly empty. only last segment
+    };
+
+    struct RouteSegment {
+      RouteSegmentKind kind{ RouteSegmentKind::Literal };
+      std::string_view text{}; // only for literals
+    };
+
+    constexpr RouteSegmentKind route_segment_kind(std::string_view segment) {
+      if (segment == "{int}") {
+        return RouteSegmentKind::Int;
+      } else if (segment == "{int64}") {
+        return RouteSegmentKind::Int64;
+      } else if (segment == "{string}") {
+        return RouteSegmentKind::String;
+      } else if (segment == "{ulid}") {
+        return RouteSegmentKind::Ulid;
+      } else if (segment == "{path}") {
+        return RouteSegmentKind::Tail;
+      }
+      return RouteSegmentKind::Literal;
+    }
+
+    constexpr bool route_is_valid(std::string_view path) {
+      if (!path.starts_with('/')) {
+        return false;
+      }
+      while (!path.empty()) {
+        path.remove_prefix(1);
+        auto segment = path.substr(0, path.find('/'));
+        path.remove_prefix(segment.size());
+        bool braces  = segment.find('{') != std::string_view::npos || segment.find('}') != std::string_view::npos;
+        if (braces && route_segment_kind(segment) == RouteSegmentKind::Literal) {
+          return false; // unknown placeholder or placeholder mixed with text
+        }
+        if (route_segment_kind(segment) == RouteSegmentKind::Tail && !path.empty()) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    template <FixedString Path>
+    constexpr auto route_segments() {
+      constexpr auto path  = Path.view();
+      constexpr auto count = static_cast<size_t>(std::count(path.begin(), path.end(), '/'));
+
+      std::array<RouteSegment, count> result{};
+      auto                            rest = path;
+      for (auto& segment : result) {
+        rest.remove_prefix(1);
+        segment.text = rest.substr(0, rest.find('/'));
+        segment.kind = route_segment_kind(segment.text);
+        rest.remove_prefix(segment.text.size());
+      }
+      return result;
+    }
+
+    template <RouteSegmentKind Kind>
+    struct RouteParam;
+    template <>
+    struct RouteParam<RouteSegmentKind::Int> {
+      using type = int;
+    };
+    template <>
+    struct RouteParam<RouteSegmentKind::Int64> {
+      using type = int64_t;
+    };
+    template <>
+    struct RouteParam<RouteSegmentKind::String> {
+      using type = std::string_view;
+    };
+    template <>
+    struct RouteParam<RouteSegmentKind::Ulid> {
+      using type = Ulid;
+    };
+    template <>
+    struct RouteParam<RouteSegmentKind::Tail> {
+      using type = std::string_view;
+    };
+
+    template <FixedString Path>
+    constexpr size_t route_params_count() {
+      size_t result{ 0 };
+      for (auto& segment : route_segments<Path>()) {
+        result += segment.kind != RouteSegmentKind::Literal ? 1 : 0;
+      }
+      return result;
+    }
+
+    // index of param in tuple by index of segment
+    template <FixedString Path, size_t Segment>
+    constexpr size_t route_param_index() {
+      size_t result{ 0 };
+      for (size_t i = 0; i < Segment; i++) {
+        result += route_segments<Path>()[i].kind != RouteSegmentKind::Literal ? 1 : 0;
+      }
+      return result;
+    }
+
+    // index of segment by index of param in tuple
+    template <FixedString Path, size_t Param>
+    constexpr size_t route_param_segment() {
+      constexpr auto segments = route_segments<Path>();
+      for (size_t i = 0, param = 0; i < segments.size(); i++) {
+        if (segments[i].kind != RouteSegmentKind::Literal && param++ == Param) {
+          return i;
+        }
+      }
+      return segments.size();
+    }
+
+    template <FixedString Path, size_t... I>
+    auto route_params_type(std::index_sequence<I...>)
+        -> std::tuple<typename RouteParam<route_segments<Path>()[route_param_segment<Path, I>()].kind>::type...>;
+
+    // only canonical non negative numbers: no sign, no leading zeros
+    template <typename T>
+    requires std::is_integral_v<T>
+    bool parse_route_param(std::string_view text, T& value) {
+      if (text.empty() || (text.size() > 1 && text[0] == '0') || text[0] < '0' || text[0] > '9') {
+        return false;
+      }
+      auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+      return ec == std::errc{} && end == text.data() + text.size();
+    }
+
+    inline bool parse_route_param(std::string_view text, std::string_view& value) {
+      value = text;
+      return !text.empty();
+    }
+
+    inline bool parse_route_param(std::string_view text, Ulid& value) { return value.decode(text); }
+  } // namespace detail
+
+  //---------------------------------------------------------------
+  // route with typed placeholders, parsed at compile time.
+  // handlers declare it as `using Route = http::Route<"/api/part/{int}/{string}">;`
+  // and get `Route::Params` (std::tuple<int, std::string_view>) filled from request path.
+  // string params are views into request url.
+  template <FixedString Path>
+  class Route {
+    static_assert(detail::route_is_valid(Path.view()), "route should start with '/' and contain only known placeholders");
+
+    using Kind = detail::RouteSegmentKind;
+
+    static constexpr auto segments = detail::route_segments<Path>();
+
+  public:
+    using Params = decltype(detail::route_params_type<Path>(std::make_index_sequence<detail::route_params_count<Path>()>{}));
+
+    static constexpr std::string_view pattern = Path.view();
+
+    /** @brief matches path (without query string) and parses params, params are garbage on failure. */
+    static bool match(std::string_view path, Params& params) {
+      return match_segments(path, params, std::make_index_sequence<segments.size()>{});
+    }
+
+    static bool match(std::string_view path) {
+      Params params{};
+      return match(path, params);
+    }
+
+  private:
+    template <size_t... I>
+    static bool match_segments(std::string_view path, Params& params, std::index_sequence<I...>) {
+      return (match_segment<I>(path, params) && ...) && path.empty();
+    }
+
+    template <size_t I>
+    static bool match_segment(std::string_view& path, Params& params) {
+      if (!path.starts_with('/')) {
+        return false;
+      }
+      path.remove_prefix(1);
+      auto text = segments[I].kind == Kind::Tail ? path : path.substr(0, path.find('/'));
+      path.remove_prefix(text.size());
+
+      if constexpr (segments[I].kind == Kind::Literal) {
+        return text == segments[I].text;
+      } else if constexpr (segments[I].kind == Kind::Tail) {
+        std::get<detail::route_param_index<Path, I>()>(params) = text;
+        return true;
+      } else {
+        return detail::parse_route_param(text, std::get<detail::route_param_index<Path, I>()>(params));
+      }
+    }
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
@@ -0,0 +1,62 @@
+#pragma once
+#include "http-server/pch.hpp"
+#include "http-server/timer-wheel.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+  // per loop callbacks: ready queue is drained by one idle handle on next loop iteration,
+  // timers are kept in millisecond wheel and one loop timer is set to nearest of them.
+  // used on loop thread only.
+  class Scheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // intrusive entry owned by user, cancelled on destruction. callback could destroy timer
+    class Timer : private TimerWheel::Node {
+      friend class Scheduler;
+
+      std::function<void()> callback_;
+
+    public:
+      explicit Timer(std::function<void()> callback)
+          : callback_{ std::move(callback) } {}
+      ~Timer() { cancel(); }
+
+      Timer(const Timer&)            = delete;
+      Timer& operator=(const Timer&) = delete;
+
+      /** @brief (re)arms timer, callback is called once after delay. */
+      void start(std::chrono::milliseconds delay);
+      void cancel();
+
+      [[nodiscard]] bool armed() const { return linked(); }
+    };
+
+  private:
+    Clock::time_point                  start_{ Clock::now() };
+    TimerWheel                         wheel_{ 0 }; // ticks are milliseconds since start_
+    std::optional<uint64_t>            wakeup_{};   // tick loop timer is set to
+    std::vector<std::function<void()>> ready_{};
+    std::vector<std::function<void()>> running_{};
+    std::shared_ptr<uvw::IdleHandle>   idle_{};
+    std::shared_ptr<uvw::TimerHandle>  timer_{};
+
+  public:
+    static Scheduler& local();
+
+    /** @brief callback is called on next loop iteration, in order of posting. */
+    void post(std::function<void()> callback);
+
+  private:
+    Scheduler() = default;
+
+    void add(Timer* timer, std::chrono::milliseconds delay);
+    void remove(Timer* timer);
+    void run_ready();
+    void run_timers();
+    void update_wakeup();
+    [[nodiscard]] uint64_t now_tick() const;
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
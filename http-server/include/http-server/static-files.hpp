@@ -0,0 +1,108 @@
+#pragma once
+#include "http-server/pch.hpp"
+#include "http-server/http-server.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+
+  struct StaticFilesSettings {
+    std::string               root{};                                  // directory with files
+    std::string               index{ "index.html" };                   // served for directory paths
+    std::string               cache_control{};                         // Cache-Control value, not sent if empty
+    std::chrono::milliseconds revalidate{ std::chrono::seconds{ 1 } }; // cached file is checked by stat after it
+    size_t                    max_open_files{ 256 };                   // least recently used are closed above it
+  };
+
+  //---------------------------------------------------------------
+  // opened file with validators, fd is closed when last user releases it.
+  struct CachedFile {
+    uv_file                               fd{ -1 };
+    uint64_t                              size{ 0 };
+    uint64_t                              mtime{ 0 }; // nanoseconds
+    uint64_t                              ino{ 0 };
+    std::string                           etag{};
+    std::string                           last_modified{};
+    std::string_view                      content_type{};
+    std::chrono::steady_clock::time_point checked_at{};
+
+    CachedFile() = default;
+    CachedFile(const CachedFile&) = delete;
+    CachedFile& operator=(const CachedFile&) = delete;
+    ~CachedFile();
+  };
+
+  //---------------------------------------------------------------
+  // open file descriptors and stat results by path, so hot files are served
+  // without open/fstat/close per request. entries are revalidated by stat
+  // when older than settings.revalidate, changed files are reopened.
+  // used on loop thread only.
+  class FileCache {
+    struct Entry {
+      std::shared_ptr<CachedFile>      file;
+      std::list<std::string>::iterator lru;
+    };
+
+    const StaticFilesSettings&             settings_;
+    std::unordered_map<std::string, Entry> entries_{};
+    std::list<std::string>                 lru_{}; // most recently used first
+
+  public:
+    explicit FileCache(const StaticFilesSettings& settings)
+        : settings_{ settings } {}
+
+    /** @brief returns nullptr if path is not a readable regular file. */
+    Task<std::shared_ptr<CachedFile>> open(std::string path);
+
+  private:
+    std::shared_ptr<CachedFile> find(const std::string& path);
+    void                        insert(const std::string& path, std::shared_ptr<CachedFile> file);
+    void                        erase(const std::string& path);
+  };
+
+  //---------------------------------------------------------------
+  // files from settings.root by path relative to route prefix.
+  // supports conditional requests (ETag, Last-Modified) and single byte ranges.
+  class StaticFiles {
+    StaticFilesSettings settings_;
+    FileCache           cache_;
+
+  public:
+    explicit StaticFiles(StaticFilesSettings settings)
+        : settings_{ std::move(settings) }
+        , cache_{ settings_ } {}
+
+    StaticFiles(const StaticFiles&) = delete;
+    StaticFiles& operator=(const StaticFiles&) = delete;
+
+    /** @brief path is url encoded path relative to root, as captured by {path}. */
+    Task<HttpResponse> serve(const HttpRequest& request, std::string_view path);
+  };
+
+  //---------------------------------------------------------------
+  // handler created by HttpServer::add_static_files<Path>, Path ends with "/{path}"
+  template <FixedString Path>
+  struct StaticFilesHandler : public HttpCoroutineHandler {
+    static constexpr HttpMethod method = HttpMethod::GET;
+    using Route                        = http::Route<Path>;
+
+    static_assert(Route::pattern.ends_with("/{path}"), "static files route should end with /{path}");
+    static_assert(std::tuple_size_v<typename Route::Params> == 1, "static files route should have no other placeholders");
+
+    StaticFiles* files{ nullptr }; // set by add_static_files of server which handles request
+
+    typename Route::Params params{};
+
+    ~StaticFilesHandler() override = default;
+
+    AsyncResult handle_async() override { return files->serve(request, std::get<0>(params)); }
+  };
+
+  template <FixedString Path>
+  void HttpServer::add_static_files(StaticFilesSettings settings) {
+    auto files = std::make_shared<StaticFiles>(std::move(settings));
+    add_handler<StaticFilesHandler<Path>>([files = files.get()](StaticFilesHandler<Path>& handler) { handler.files = files; });
+    static_files_.push_back(std::move(files));
+  }
+
+  //---------------------------------------------------------------
+} // namespace http
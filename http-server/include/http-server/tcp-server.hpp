@@ -7,8 +7,16 @@ namespace http {
   struct ITcpWriter {
     std::stringstream data{};
 
-    virtual ~ITcpWriter() = default;
-    virtual void done()   = 0;
+    virtual ~ITcpWriter()                                  = default;
+    virtual void        done()                             = 0; // writes rest of data and closes connection
+    virtual void        flush()                            = 0; // writes data collected so far, connection stays open
+    virtual size_t      pending() const                    = 0; // bytes queued for write but not yet sent
+    virtual void        on_drain(std::function<void()> cb) = 0; // cb is called once when write queue becomes empty or connection is closed
+    virtual bool        closed() const                     = 0; // peer has gone, written data is dropped
+    virtual int         fd() const { return -1; }               // os socket descriptor, -1 if not available
+    virtual std::string peer() const { return {}; }             // ip address of client, empty if not available
+    virtual void        abort() {}                              // closes connection right away, queued data is dropped
+    virtual void        cork(bool enable) {}                    // while corked only full packets are sent, uncork sends the rest
   };
 
   //---------------------------------------------------------------
@@ -28,15 +36,68 @@ namespace http {
 
   //---------------------------------------------------------------
 
-  class TcpServer {
+  // network backend of http server: accepts connections and creates reader for each of them
+  struct ITcpServer {
+    virtual ~ITcpServer()                                    = default;
+    virtual void set_max_connections(size_t max_connections) = 0; // above limit connections wait in listen backlog
+    virtual void set_no_delay(bool no_delay)                 = 0; // TCP_NODELAY of accepted connections
+    virtual void listen(const char* addr, int port)          = 0;
+    virtual void listen(int fd)                              = 0; // socket which is already bound
+    virtual void listen_unix(const std::string& path)        = 0; // name starting with '@' is in abstract namespace
+    virtual int  fd() const                                  = 0; // listening tcp socket, -1 if not listening
+    virtual void close()                                     = 0; // stops accepting, accepted connections stay open
+  };
+
+  //---------------------------------------------------------------
+
+  // accepts connections on tcp and unix sockets with libuv, readers and writers are the same for both
+  class TcpServer : public ITcpServer {
     std::shared_ptr<uvw::TCPHandle>    handle_;
+    std::shared_ptr<uvw::PipeHandle>   pipe_{};
     std::unique_ptr<ITcpReaderFactory> reader_factory_;
+    size_t                             max_connections_{ 0 }; // 0 is unlimited
+    bool                               no_delay_{ true };
+    size_t                             connections_{ 0 };
+    std::vector<std::function<void()>> paused_{}; // accepts of listeners waiting for a free slot
 
   public:
     explicit TcpServer(std::unique_ptr<ITcpReaderFactory> client_factory);
 
-    void listen(const char* addr, int port);
+    /** @brief above limit connections are not accepted and wait in listen backlog. */
+    void set_max_connections(size_t max_connections) override { max_connections_ = max_connections; }
+
+    /** @brief TCP_NODELAY of accepted connections, writes are batched per loop iteration anyway. */
+    void set_no_delay(bool no_delay) override { no_delay_ = no_delay; }
+
+    void listen(const char* addr, int port) override;
+
+    /** @brief listens on socket which is already bound, e.g. inherited from previous process. */
+    void listen(int fd) override;
+
+    /** @brief unix socket, name starting with '@' is in abstract namespace (linux only). */
+    void listen_unix(const std::string& path) override;
+
+    /** @brief listening tcp socket, -1 if not listening. */
+    [[nodiscard]] int fd() const override;
+
+    /** @brief stops accepting, connections which are already accepted stay open. */
+    void close() override;
+
+  private:
+    template <typename THandle>
+    void setup_listener(const std::shared_ptr<THandle>& listener);
+
+    template <typename THandle>
+    void accept(THandle& handle);
   };
 
   //---------------------------------------------------------------
+
+  /**
+   * @brief removes socket file left by previous run at path, so it could be bound again.
+   * regular files and sockets which are still listened on are kept, then bind fails.
+   */
+  void remove_stale_unix_socket(const std::string& path);
+
+  //---------------------------------------------------------------
 } // namespace http
@@ -0,0 +1,67 @@
+#pragma once
+#include "http-server/pch.hpp"
+
+namespace http {
+  //---------------------------------------------------------------
+  // hierarchical timer wheel over abstract ticks, insert and remove are O(1).
+  // level 0 has one slot per tick, each next level has one slot per whole turn of previous one,
+  // timers move to lower level when its slot is reached. timers further than all levels span
+  // are parked in top level and placed again when reached.
+  class TimerWheel {
+  public:
+    static constexpr size_t   slot_bits{ 6 };
+    static constexpr size_t   slots_count{ 1 << slot_bits };
+    static constexpr size_t   levels_count{ 5 };
+    static constexpr uint64_t max_span{ (uint64_t{ 1 } << (slot_bits * levels_count)) - 1 };
+    static constexpr uint8_t  not_in_wheel{ 0xff }; // level of node which is due or unlinked
+
+    // intrusive entry, embedded into user's timer
+    struct Node {
+      Node*    prev{ this };
+      Node*    next{ this };
+      uint64_t expires{ 0 }; // tick
+      uint8_t  level{ not_in_wheel };
+      uint8_t  slot{ 0 };
+
+      void               link_before(Node* node);
+      void               unlink();
+      [[nodiscard]] bool linked() const { return next != this; }
+    };
+
+  private:
+    std::array<std::array<Node, slots_count>, levels_count> slots_{};
+    std::array<uint64_t, levels_count>                      occupied_{}; // bit per non-empty slot
+    uint64_t                                                now_;
+    size_t                                                  count_{ 0 };
+
+  public:
+    explicit TimerWheel(uint64_t now)
+        : now_{ now } {}
+
+    TimerWheel(const TimerWheel&)            = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    [[nodiscard]] uint64_t now() const { return now_; }
+    [[nodiscard]] size_t   size() const { return count_; }
+
+    /** @brief node->expires should be set, expired ones are due on next advance. */
+    void insert(Node* node);
+
+    /** @brief unlinks node either from wheel or from due list. */
+    void remove(Node* node);
+
+    /** @brief moves timers expired by now to due list in order of expiration. */
+    void advance(uint64_t now, Node& due);
+
+    /** @brief tick when advance has something to do, nullopt if wheel is empty. */
+    [[nodiscard]] std::optional<uint64_t> next_expiry() const;
+
+  private:
+    void place(Node* node, uint64_t earliest);
+    void link(Node* node, uint8_t level, uint8_t slot);
+    void detach(uint8_t level, uint8_t slot, Node& list);
+    void cascade();
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
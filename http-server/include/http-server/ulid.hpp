@@ -13,7 +13,15 @@ namespace http {
     Ulid() = default;
 
     bool decode(const char* text) { return ulid_decode(bytes_, text) == 0; }
-    bool decode(const std::string& text) { return decode(text.c_str()); }
+    bool decode(const std::string& text) { return decode(std::string_view{ text }); }
+
+    bool decode(std::string_view text) {
+      // ulid_decode reads exactly 26 chars and indexes table by them
+      if (text.size() != 26 || std::any_of(text.begin(), text.end(), [](char c) { return static_cast<unsigned char>(c) >= 0x80; })) {
+        return false;
+      }
+      return decode(text.data());
+    }
 
     [[nodiscard]] std::string str() const {
       std::string result(26, '\0');
@@ -0,0 +1,99 @@
+#pragma once
+#include "http-server/pch.hpp"
+#include "http-server/tcp-server.hpp"
+#include "http-server/scheduler.hpp"
+
+#ifdef HTTP_SERVER_IO_URING
+
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace http {
+  struct UringConnection;
+  struct UringWriter;
+  class UringRing;
+
+  //---------------------------------------------------------------
+  // linux io_uring transport, alternative to libuv sockets of TcpServer. listeners use multishot
+  // accept, connections receive with multishot recv into ring of provided buffers and write
+  // everything collected during loop iteration with one sendmsg, last one is linked with close.
+  // ring is driven by libuv loop: completions are reaped when ring descriptor is readable and
+  // queued requests are submitted with one syscall right before loop polls again.
+  // used on loop thread only.
+  class UringServer : public ITcpServer {
+    friend struct UringWriter;
+
+    static constexpr unsigned ring_entries{ 1024 };
+    static constexpr unsigned buffers_count{ 256 }; // provided for receives, power of 2
+    static constexpr unsigned buffer_size{ 16 * 1024 };
+    static constexpr uint16_t buffer_group{ 0 };
+
+    static constexpr std::chrono::milliseconds accept_backoff{ 100 }; // while process is out of descriptors
+
+    struct Listener {
+      int  fd;
+      bool tcp;
+      bool armed{ false };   // multishot accept is running
+      bool closing{ false }; // accept is cancelled, socket is closed on its completion
+    };
+
+    std::unique_ptr<UringRing>                                            ring_;
+    std::unique_ptr<ITcpReaderFactory>                                    reader_factory_;
+    std::shared_ptr<uvw::PollHandle>                                      poll_{};    // ring has completions
+    std::shared_ptr<uvw::PrepareHandle>                                   prepare_{}; // submits before loop polls
+    std::vector<std::unique_ptr<Listener>>                                listeners_{};
+    std::unordered_map<UringConnection*, std::shared_ptr<UringConnection>> connections_{};
+    std::vector<UringConnection*>                                         dirty_{}; // have data to send
+    std::unique_ptr<std::byte[]>                                          buffers_{};
+    io_uring_buf_ring*                                                    buffer_ring_{ nullptr };
+    size_t                                                                max_connections_{ 0 }; // 0 is unlimited
+    bool                                                                  no_delay_{ true };
+    bool                                                                  paused_{ false }; // accepts are cancelled by connection limit
+    Scheduler::Timer                                                      accept_retry_{ [this] { arm_accepts(); } };
+
+  public:
+    /** @brief nullptr if kernel doesn't support features used by server. */
+    static std::unique_ptr<UringServer> create(std::unique_ptr<ITcpReaderFactory> reader_factory);
+
+    ~UringServer() override;
+
+    UringServer(const UringServer&)            = delete;
+    UringServer& operator=(const UringServer&) = delete;
+
+    void set_max_connections(size_t max_connections) override { max_connections_ = max_connections; }
+    void set_no_delay(bool no_delay) override { no_delay_ = no_delay; }
+    void listen(const char* addr, int port) override;
+    void listen(int fd) override;
+    void listen_unix(const std::string& path) override;
+    [[nodiscard]] int fd() const override;
+    void close() override;
+
+  private:
+    explicit UringServer(std::unique_ptr<ITcpReaderFactory> reader_factory);
+
+    bool init();
+    bool probe_recv_multishot();
+    void start_listener(int fd);
+    void arm_accept(Listener* listener);
+    void arm_accepts();
+    void arm_recv(UringConnection* connection);
+    void accept_connection(Listener* listener, int fd);
+    void send(UringConnection* connection);
+    void finish_send(UringConnection* connection, int result);
+    void close_connection(UringConnection* connection);
+    void submit_close(UringConnection* connection);
+    void finish_connection(UringConnection* connection);
+    void mark_dirty(UringConnection* connection);
+    void recycle_buffer(uint16_t id);
+    void update_reference();
+
+    void on_completion(const io_uring_cqe& cqe);
+    void on_accept(Listener* listener, const io_uring_cqe& cqe);
+    void on_recv(UringConnection* connection, const io_uring_cqe& cqe);
+    void on_close(UringConnection* connection, const io_uring_cqe& cqe);
+  };
+
+  //---------------------------------------------------------------
+} // namespace http
+
+#endif
@@ -35,91 +35,40 @@ namespace http {
   void        next_tick(std::function<void()> func);
   int         run_main_loop();
   std::string replace_all(std::string str, std::string_view from, std::string_view to);
+  bool        iequals(std::string_view a, std::string_view b); // ascii case insensitive
+
+  /** @brief decodes %XX escapes of url path, nullopt on malformed escape. '+' is kept as is. */
+  std::optional<std::string> url_decode(std::string_view str);
 
   std::function<void(const std::exception_ptr&)> unwrap_exception_ptr(
       std::function<void(const std::exception&)> on_ex);
 
-
-  // TODO: reduce copypasta
-  // TODO: other types
-  namespace url {
-    template <typename T>
-    T unwrap_base(const std::string& str) {
-      if constexpr (std::is_same_v<T, int>) {
-        if (str.empty() || str.starts_with('0')) {
-          throw std::exception();
-        }
-        return std::stoi(str);
-      } else if constexpr (std::is_same_v<T, std::string>) {
-        return str;
+  // transparent hash and equality, so string keys of any allocator are looked up by std::string_view
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const noexcept { return std::hash<std::string_view>{}(str); }
+  };
+
+  struct StringEqual {
+    using is_transparent = void;
+    bool operator()(std::string_view a, std::string_view b) const noexcept { return a == b; }
+  };
+
+  // same, but ascii case insensitive: header names are compared like this
+  struct StringCaseHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const noexcept {
+      size_t hash = 14695981039346656037ull; // fnv-1a of lowercased string
+      for (unsigned char c : str) {
+        hash ^= (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+        hash *= 1099511628211ull;
       }
-      throw std::exception();
+      return hash;
     }
+  };
 
-    template <typename T1>
-    bool unwrap(const std::smatch& url_match, T1& t1) {
-      if (url_match.size() != 2) {
-        return false;
-      }
-
-      try {
-        t1 = unwrap_base<T1>(url_match[1]);
-      } catch (...) {
-        return false;
-      }
-
-      return true;
-    }
-
-    template <typename T1, typename T2>
-    bool unwrap(const std::smatch& url_match, T1& t1, T2& t2) {
-      if (url_match.size() != 3) {
-        return false;
-      }
-
-      try {
-        t1 = unwrap_base<T1>(url_match[1]);
-        t2 = unwrap_base<T2>(url_match[2]);
-      } catch (...) {
-        return false;
-      }
-
-      return true;
-    }
-
-    template <typename T1, typename T2, typename T3>
-    bool unwrap(const std::smatch& url_match, T1& t1, T2& t2, T3& t3) {
-      if (url_match.size() != 4) {
-        return false;
-      }
-
-      try {
-        t1 = unwrap_base<T1>(url_match[1]);
-        t2 = unwrap_base<T2>(url_match[2]);
-        t3 = unwrap_base<T3>(url_match[3]);
-      } catch (...) {
-        return false;
-      }
-
-      return true;
-    }
-
-    template <typename T1, typename T2, typename T3, typename T4>
-    bool unwrap(const std::smatch& url_match, T1& t1, T2& t2, T3& t3, T4& t4) {
-      if (url_match.size() != 5) {
-        return false;
-      }
-
-      try {
-        t1 = unwrap_base<T1>(url_match[1]);
-        t2 = unwrap_base<T2>(url_match[2]);
-        t3 = unwrap_base<T3>(url_match[3]);
-        t4 = unwrap_base<T4>(url_match[4]);
-      } catch (...) {
-        return false;
-      }
-
-      return true;
-    }
-  } // namespace url
+  struct StringCaseEqual {
+    using is_transparent = void;
+    bool operator()(std::string_view a, std::string_view b) const noexcept { return iequals(a, b); }
+  };
 } // namespace http
@@ -0,0 +1,74 @@
+#include "http-server/admission.hpp"
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+AdaptiveLimit::AdaptiveLimit(size_t min_limit, size_t max_limit)
+    : limit_{ static_cast<double>(min_limit) }
+    , min_limit_{ static_cast<double>(min_limit) }
+    , max_limit_{ static_cast<double>(std::max(min_limit, max_limit)) } {}
+
+void AdaptiveLimit::on_sample(std::chrono::nanoseconds rtt, size_t in_flight) {
+  window_rtt_ += static_cast<double>(rtt.count());
+  window_samples_++;
+  window_in_flight_ = std::max(window_in_flight_, in_flight);
+
+  auto now = Clock::now();
+  if (window_samples_ < min_window_samples || now - window_start_ < window) {
+    return;
+  }
+
+  double short_rtt = std::max(window_rtt_ / static_cast<double>(window_samples_), 1.0);
+  bool   saturated = static_cast<double>(window_in_flight_) * 2 >= limit_;
+  window_rtt_       = 0;
+  window_samples_   = 0;
+  window_in_flight_ = 0;
+  window_start_     = now;
+
+  long_rtt_ = long_rtt_ == 0 ? short_rtt : long_rtt_ * 0.95 + short_rtt * 0.05;
+  if (long_rtt_ / short_rtt > 2) {
+    long_rtt_ *= 0.95; // load has dropped, long term average follows faster
+  }
+
+  // less than half of limit is used, latency says nothing about it
+  if (!saturated) {
+    return;
+  }
+
+  double gradient  = std::clamp(tolerance * long_rtt_ / short_rtt, 0.5, 1.0);
+  double new_limit = limit_ * gradient + std::sqrt(limit_);
+  limit_           = std::clamp(limit_ * (1 - smoothing) + new_limit * smoothing, min_limit_, max_limit_);
+}
+
+//---------------------------------------------------------------
+
+void AdmissionControl::configure(AdmissionSettings settings) {
+  settings_ = settings;
+  adaptive_.reset();
+  if (settings_.adaptive) {
+    adaptive_.emplace(settings_.min_in_flight, settings_.max_in_flight != 0 ? settings_.max_in_flight : 1024);
+  }
+}
+
+size_t AdmissionControl::limit() const {
+  return adaptive_ ? adaptive_->limit() : settings_.max_in_flight;
+}
+
+bool AdmissionControl::try_acquire() {
+  auto max = limit();
+  if (max != 0 && in_flight_ >= max) {
+    return false;
+  }
+  in_flight_++;
+  return true;
+}
+
+void AdmissionControl::release(Clock::time_point admitted_at) {
+  if (adaptive_) {
+    adaptive_->on_sample(Clock::now() - admitted_at, in_flight_);
+  }
+  in_flight_--;
+}
+
+//---------------------------------------------------------------
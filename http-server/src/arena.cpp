@@ -0,0 +1,58 @@
+#include "http-server/arena.hpp"
+
+using namespace http;
+
+// trivially destructible, so it's still readable by requests destroyed during thread-local teardown
+static thread_local bool t_pool_destroyed{ false };
+
+//---------------------------------------------------------------
+
+void Arena::Recycle::operator()(Arena* arena) const {
+  if (auto pool = ArenaPool::local()) {
+    pool->release(arena);
+  } else {
+    delete arena;
+  }
+}
+
+Arena::Ptr Arena::make() {
+  if (auto pool = ArenaPool::local()) {
+    return pool->acquire();
+  }
+  return Arena::Ptr{ new Arena() };
+}
+
+//---------------------------------------------------------------
+
+ArenaPool::~ArenaPool() {
+  t_pool_destroyed = true;
+}
+
+ArenaPool* ArenaPool::local() {
+  if (t_pool_destroyed) {
+    return nullptr;
+  }
+  static thread_local ArenaPool pool;
+  return &pool;
+}
+
+Arena::Ptr ArenaPool::acquire() {
+  if (free_.empty()) {
+    return Arena::Ptr{ new Arena() };
+  }
+  auto arena = std::move(free_.back());
+  free_.pop_back();
+  return Arena::Ptr{ arena.release() };
+}
+
+void ArenaPool::release(Arena* arena) {
+  // heap blocks are freed, bump pointer goes back to start of embedded block
+  arena->resource_.release();
+  if (free_.size() < max_free) {
+    free_.emplace_back(arena);
+  } else {
+    delete arena;
+  }
+}
+
+//---------------------------------------------------------------
@@ -0,0 +1,70 @@
+#include "http-server/cancellation.hpp"
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+CancellationToken CancellationToken::make() {
+  CancellationToken token;
+  token.state_ = std::make_shared<State>();
+  return token;
+}
+
+bool CancellationToken::cancelled() const {
+  if (!state_) {
+    return false;
+  }
+  return state_->cancelled.load(std::memory_order_acquire) ||
+         Clock::now().time_since_epoch().count() >= state_->deadline.load(std::memory_order_relaxed);
+}
+
+ErrorCode CancellationToken::reason() const {
+  if (!state_) {
+    return ErrorCode::None;
+  }
+  if (state_->cancelled.load(std::memory_order_acquire)) {
+    return ErrorCode::Cancelled;
+  }
+  return cancelled() ? ErrorCode::DeadlineExceeded : ErrorCode::None;
+}
+
+void CancellationToken::cancel() {
+  if (!state_ || state_->cancelled.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
+  std::unique_lock<std::mutex> _{ state_->lock };
+  for (auto& [id, cb] : state_->callbacks) {
+    cb();
+  }
+  state_->callbacks.clear();
+}
+
+void CancellationToken::set_deadline(Clock::time_point deadline) {
+  if (state_) {
+    state_->deadline.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+  }
+}
+
+size_t CancellationToken::on_cancel(std::function<void()> cb) {
+  if (!state_) {
+    return 0;
+  }
+  std::unique_lock<std::mutex> _{ state_->lock };
+  if (state_->cancelled.load(std::memory_order_acquire)) {
+    cb();
+    return 0;
+  }
+  auto id = ++state_->next_callback_id;
+  state_->callbacks.emplace(id, std::move(cb));
+  return id;
+}
+
+void CancellationToken::remove_on_cancel(size_t id) {
+  if (!state_ || id == 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> _{ state_->lock };
+  state_->callbacks.erase(id);
+}
+
+//---------------------------------------------------------------
@@ -0,0 +1,162 @@
+#include "http-server/compression.hpp"
+#include "http-server/error.hpp"
+#include "http-server/utils.hpp"
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+static std::string_view trim(std::string_view str) {
+  while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+std::string_view http::to_string(ContentEncoding encoding) {
+  switch (encoding) {
+    case ContentEncoding::Gzip: return "gzip";
+    case ContentEncoding::Deflate: return "deflate";
+    default: return "identity";
+  }
+}
+
+ContentEncoding http::negotiate_content_encoding(std::string_view accept_encoding) {
+  double gzip_q{ -1 }; // -1 if not listed
+  double deflate_q{ -1 };
+  double any_q{ -1 };
+
+  while (!accept_encoding.empty()) {
+    auto item = accept_encoding.substr(0, accept_encoding.find(','));
+    accept_encoding.remove_prefix(std::min(item.size() + 1, accept_encoding.size()));
+
+    auto   semicolon = item.find(';');
+    auto   coding    = trim(item.substr(0, semicolon));
+    double q{ 1 };
+    if (semicolon != std::string_view::npos) {
+      auto param = trim(item.substr(semicolon + 1));
+      if (param.starts_with("q=") || param.starts_with("Q=")) {
+        param.remove_prefix(2);
+        if (std::from_chars(param.data(), param.data() + param.size(), q).ec != std::errc{}) {
+          q = 0;
+        }
+      }
+    }
+
+    if (iequals(coding, "gzip") || iequals(coding, "x-gzip")) {
+      gzip_q = q;
+    } else if (iequals(coding, "deflate")) {
+      deflate_q = q;
+    } else if (coding == "*") {
+      any_q = q;
+    }
+  }
+
+  gzip_q    = gzip_q < 0 ? any_q : gzip_q;
+  deflate_q = deflate_q < 0 ? any_q : deflate_q;
+
+  if (gzip_q > 0 && gzip_q >= deflate_q) {
+    return ContentEncoding::Gzip;
+  } else if (deflate_q > 0) {
+    return ContentEncoding::Deflate;
+  }
+  return ContentEncoding::Identity;
+}
+
+bool http::is_compressible(std::string_view content_type) {
+  auto type = trim(content_type.substr(0, content_type.find(';')));
+  return type.starts_with("text/") ||
+         type.ends_with("/json") || type.ends_with("+json") ||
+         type.ends_with("/xml") || type.ends_with("+xml") ||
+         type.ends_with("/javascript");
+}
+
+//---------------------------------------------------------------
+
+Compressor::Compressor(ContentEncoding encoding, int level)
+    : encoding_{ encoding }
+    , level_{ level } {
+  // window bits: 15 is zlib format (http "deflate"), +16 is gzip format
+  int window_bits = encoding == ContentEncoding::Gzip ? 15 + 16 : 15;
+  if (deflateInit2(&stream_, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw Error{ ErrorCode::CompressionFailed };
+  }
+}
+
+Compressor::~Compressor() {
+  deflateEnd(&stream_);
+}
+
+void Compressor::reset(int level) {
+  deflateReset(&stream_);
+  if (level != level_ && deflateParams(&stream_, level, Z_DEFAULT_STRATEGY) == Z_OK) {
+    level_ = level;
+  }
+}
+
+void Compressor::write(std::string_view input, std::string& output) {
+  deflate(input, output, Z_SYNC_FLUSH);
+}
+
+void Compressor::finish(std::string_view input, std::string& output) {
+  deflate(input, output, Z_FINISH);
+}
+
+void Compressor::deflate(std::string_view input, std::string& output, int flush) {
+  stream_.next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream_.avail_in = static_cast<uInt>(input.size());
+
+  auto step = std::max<size_t>(deflateBound(&stream_, static_cast<uLong>(input.size())), 64);
+  while (true) {
+    auto offset = output.size();
+    output.resize(offset + step);
+    stream_.next_out  = reinterpret_cast<Bytef*>(output.data() + offset);
+    stream_.avail_out = static_cast<uInt>(step);
+
+    int result = ::deflate(&stream_, flush);
+    output.resize(output.size() - stream_.avail_out);
+
+    if (result == Z_STREAM_ERROR) {
+      throw Error{ ErrorCode::CompressionFailed };
+    }
+    if (flush == Z_FINISH ? result == Z_STREAM_END : stream_.avail_out != 0) {
+      return;
+    }
+  }
+}
+
+//---------------------------------------------------------------
+
+void CompressorReleaser::operator()(Compressor* compressor) const noexcept {
+  CompressorPool::local().release(compressor);
+}
+
+CompressorHandle CompressorPool::acquire(ContentEncoding encoding, int level) {
+  auto& free = free_[static_cast<size_t>(encoding)];
+  if (free.empty()) {
+    return CompressorHandle{ new Compressor(encoding, level) };
+  }
+  auto compressor = std::move(free.back());
+  free.pop_back();
+  compressor->reset(level);
+  return CompressorHandle{ compressor.release() };
+}
+
+void CompressorPool::release(Compressor* compressor) noexcept {
+  auto& free = free_[static_cast<size_t>(compressor->encoding())];
+  if (free.size() >= max_free) {
+    delete compressor;
+    return;
+  }
+  free.emplace_back(compressor);
+}
+
+CompressorPool& CompressorPool::local() {
+  static thread_local CompressorPool pool;
+  return pool;
+}
+
+//---------------------------------------------------------------
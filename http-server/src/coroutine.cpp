@@ -0,0 +1,58 @@
+#include "http-server/coroutine.hpp"
+
+using namespace http;
+using namespace http::detail;
+
+//---------------------------------------------------------------
+
+FramePool::~FramePool() {
+  for (auto* block : free_) {
+    while (block) {
+      auto* next = block->next;
+      ::operator delete(block);
+      block = next;
+    }
+  }
+}
+
+void* FramePool::allocate(size_t size) {
+  size_t index = (size + granularity - 1) / granularity - 1;
+  if (index >= classes_count) {
+    return ::operator new(size);
+  }
+
+  if (auto* block = free_[index]) {
+    free_[index] = block->next;
+    free_count_[index]--;
+    return block;
+  }
+
+  return ::operator new((index + 1) * granularity);
+}
+
+void FramePool::deallocate(void* ptr, size_t size) noexcept {
+  size_t index = (size + granularity - 1) / granularity - 1;
+  if (index >= classes_count || free_count_[index] >= max_free_blocks) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  auto* block   = static_cast<FreeBlock*>(ptr);
+  block->next   = free_[index];
+  free_[index]  = block;
+  free_count_[index]++;
+}
+
+FramePool& FramePool::local() {
+  static thread_local FramePool pool;
+  return pool;
+}
+
+//---------------------------------------------------------------
+
+void SleepAwaitable::await_suspend(std::coroutine_handle<> handle) {
+  handle_ = handle;
+  timer_.start(timeout_);
+}
+
+//---------------------------------------------------------------
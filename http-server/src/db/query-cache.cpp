@@ -0,0 +1,70 @@
+#include "http-server/db/query-cache.hpp"
+#include "http-server/log.hpp"
+
+using namespace http::db;
+
+//---------------------------------------------------------------
+
+const std::any* QueryCache::find(std::string_view key) {
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return nullptr;
+  }
+
+  auto entry = it->second;
+  if (Clock::now() >= entry->expires || versions(entry->tables) != entry->versions) {
+    erase(entry);
+    return nullptr;
+  }
+
+  lru_.splice(lru_.begin(), lru_, entry);
+  return &entry->value;
+}
+
+std::vector<uint64_t> QueryCache::versions(const std::vector<std::string>& tables) const {
+  std::vector<uint64_t> result;
+  result.reserve(tables.size());
+  for (auto& table : tables) {
+    auto it = table_versions_.find(table);
+    result.push_back(it == table_versions_.end() ? 0 : it->second);
+  }
+  return result;
+}
+
+void QueryCache::put(const CachedQuery& query, std::vector<uint64_t> versions, std::any value) {
+  if (this->versions(query.tables) != versions) {
+    g_log->debug("query cache: tables changed while query was running, skip caching");
+    return;
+  }
+
+  if (auto it = index_.find(query.key); it != index_.end()) {
+    erase(it->second);
+  }
+
+  auto ttl = query.ttl.count() != 0 ? query.ttl : settings_.default_ttl;
+  lru_.emplace_front(Entry{
+      .key      = query.key,
+      .value    = std::move(value),
+      .expires  = Clock::now() + ttl,
+      .tables   = query.tables,
+      .versions = std::move(versions),
+  });
+  index_.emplace(lru_.front().key, lru_.begin());
+
+  while (lru_.size() > settings_.max_entries) {
+    erase(std::prev(lru_.end()));
+  }
+}
+
+void QueryCache::invalidate(const std::vector<std::string>& tables) {
+  for (auto& table : tables) {
+    table_versions_[table]++;
+  }
+}
+
+void QueryCache::erase(EntryList::iterator it) {
+  index_.erase(it->key);
+  lru_.erase(it);
+}
+
+//---------------------------------------------------------------
@@ -0,0 +1,174 @@
+#include "http-server/handoff.hpp"
+#include "http-server/log.hpp"
+
+#ifndef _WIN32
+  #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+
+  // linux only flags, descriptors are not leaked to children anyway unless exec happens meanwhile
+  #ifndef SOCK_CLOEXEC
+    #define SOCK_CLOEXEC 0
+  #endif
+  #ifndef MSG_CMSG_CLOEXEC
+    #define MSG_CMSG_CLOEXEC 0
+  #endif
+  #ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
+  #endif
+#endif
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+#ifndef _WIN32
+
+static constexpr size_t max_fds{ 16 };
+
+int handoff::connect(const std::string& path) {
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    g_log->error("handoff: socket path is too long: {}", path);
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.data(), path.size());
+
+  int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket < 0) {
+    g_log->error("handoff: socket error: {}", std::strerror(errno));
+    return -1;
+  }
+  if (::connect(socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    g_log->debug("handoff: nobody listens on {}: {}", path, std::strerror(errno));
+    ::close(socket);
+    return -1;
+  }
+  return socket;
+}
+
+bool handoff::send(int socket, const std::vector<int>& fds) {
+  if (fds.empty() || fds.size() > max_fds) {
+    return false;
+  }
+
+  // count of fds goes as payload, so receiver could check that nothing was truncated
+  auto   count = static_cast<uint8_t>(fds.size());
+  iovec  payload{ &count, sizeof(count) };
+  char   control[CMSG_SPACE(sizeof(int) * max_fds)]{};
+  msghdr message{};
+  message.msg_iov        = &payload;
+  message.msg_iovlen     = 1;
+  message.msg_control    = control;
+  message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+  auto header        = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type  = SCM_RIGHTS;
+  header->cmsg_len   = CMSG_LEN(sizeof(int) * fds.size());
+  std::memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+
+  ssize_t sent{ 0 };
+  do {
+    sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  if (sent != sizeof(count)) {
+    g_log->error("handoff: sendmsg error: {}", std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+std::vector<int> handoff::receive(int socket) {
+  uint8_t count{ 0 };
+  iovec   payload{ &count, sizeof(count) };
+  char    control[CMSG_SPACE(sizeof(int) * max_fds)]{};
+  msghdr  message{};
+  message.msg_iov        = &payload;
+  message.msg_iovlen     = 1;
+  message.msg_control    = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t received{ 0 };
+  do {
+    received = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+  if (received != sizeof(count)) {
+    g_log->error("handoff: recvmsg error: {}", received < 0 ? std::strerror(errno) : "connection closed");
+    return {};
+  }
+
+  std::vector<int> fds{};
+  for (auto header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+    if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+      auto size = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      auto data = reinterpret_cast<const int*>(CMSG_DATA(header));
+      fds.insert(fds.end(), data, data + size);
+    }
+  }
+
+  if (fds.size() != count || (message.msg_flags & MSG_CTRUNC)) {
+    g_log->error("handoff: expected {} sockets, got {}", count, fds.size());
+    for (int fd : fds) {
+      ::close(fd);
+    }
+    return {};
+  }
+  return fds;
+}
+
+void handoff::confirm(int socket) {
+  char ready{ 1 };
+  if (::send(socket, &ready, sizeof(ready), MSG_NOSIGNAL) != sizeof(ready)) {
+    g_log->error("handoff: confirm error: {}", std::strerror(errno));
+  }
+  ::close(socket);
+}
+
+void handoff::close(int fd) {
+  ::close(fd);
+}
+
+uint64_t handoff::inode(const std::string& path) {
+  struct stat info{};
+  if (::lstat(path.c_str(), &info) != 0 || !S_ISSOCK(info.st_mode)) {
+    return 0;
+  }
+  return static_cast<uint64_t>(info.st_ino);
+}
+
+void handoff::unlink(const std::string& path, uint64_t inode) {
+  if (inode != 0 && handoff::inode(path) == inode) {
+    ::unlink(path.c_str());
+  }
+}
+
+#else
+
+int handoff::connect(const std::string&) {
+  return -1;
+}
+
+bool handoff::send(int, const std::vector<int>&) {
+  return false;
+}
+
+std::vector<int> handoff::receive(int) {
+  return {};
+}
+
+void handoff::confirm(int) {}
+
+void handoff::close(int) {}
+
+uint64_t handoff::inode(const std::string&) {
+  return 0;
+}
+
+void handoff::unlink(const std::string&, uint64_t) {}
+
+#endif
+
+//---------------------------------------------------------------
@@ -15,7 +15,7 @@ bool HttpBodyJson::parse(const std::string& body) {
 
 //---------------------------------------------------------------
 
-std::unique_ptr<HttpBody> HttpBodyParser::parse(const std::string& content_type) {
+std::unique_ptr<HttpBody> HttpBodyParser::parse(std::string_view content_type) {
   if (content_type.starts_with("application/json")) {
     auto body = std::make_unique<HttpBodyJson>();
     if (body->parse(buffer_)) {
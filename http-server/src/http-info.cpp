@@ -5,10 +5,8 @@ using namespace http;
 
 //---------------------------------------------------------------
 
-const char* http::http_status_code_message(HttpStatusCode code) {
-  int code_base = static_cast<int>(code);
-
-  switch (code_base) {
+static const char* known_status_code_message(int code) {
+  switch (code) {
     case 200: return "200 OK";
     case 201: return "201 Created";
     case 202: return "202 Accepted";
@@ -74,10 +72,95 @@ const char* http::http_status_code_message(HttpStatusCode code) {
     case 511: return "511 Network Authentication Required";
     case 599: return "599 Network Connect Timeout Error";
 
-    default:
-      g_log->error("unknown http status code: {}", code);
-      return "500 Internal Server Error";
+    default: return nullptr;
+  }
+}
+
+const char* http::http_status_code_message(HttpStatusCode code) {
+  if (auto message = known_status_code_message(static_cast<int>(code))) {
+    return message;
+  }
+  g_log->error("unknown http status code: {}", code);
+  return "500 Internal Server Error";
+}
+
+std::string_view http::http_status_line(HttpStatusCode code) {
+  static constexpr int min_code{ 100 };
+  static constexpr int max_code{ 599 };
+
+  static const auto lines = [] {
+    std::array<std::string, max_code - min_code + 1> result{};
+    for (int code = min_code; code <= max_code; code++) {
+      if (auto message = known_status_code_message(code)) {
+        result[code - min_code] = std::string{ "HTTP/1.1 " } + message + "\r\n";
+      }
+    }
+    return result;
+  }();
+
+  auto index = static_cast<int>(code) - min_code;
+  if (index < 0 || index >= static_cast<int>(lines.size()) || lines[index].empty()) {
+    g_log->error("unknown http status code: {}", code);
+    return lines[500 - min_code];
+  }
+  return lines[index];
+}
+
+std::string_view http::http_connection_header(bool keep_alive) {
+  return keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+}
+
+std::string http::http_date(std::time_t time) {
+  static constexpr const char* week_days[]{ "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  static constexpr const char* months[]{ "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+  std::tm tm{};
+#ifdef _WIN32
+  gmtime_s(&tm, &time);
+#else
+  gmtime_r(&time, &tm);
+#endif
+  char result[32]{};
+  int  size = std::snprintf(result, sizeof(result), "%s, %02d %s %d %02d:%02d:%02d GMT",
+                            week_days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900,
+                            tm.tm_hour, tm.tm_min, tm.tm_sec);
+  return { result, static_cast<size_t>(std::max(size, 0)) };
+}
+
+bool http::etag_matches(std::string_view if_none_match, std::string_view etag) {
+  while (!if_none_match.empty()) {
+    auto item = if_none_match.substr(0, if_none_match.find(','));
+    if_none_match.remove_prefix(std::min(item.size() + 1, if_none_match.size()));
+
+    while (!item.empty() && item.front() == ' ') {
+      item.remove_prefix(1);
+    }
+    while (!item.empty() && item.back() == ' ') {
+      item.remove_suffix(1);
+    }
+    if (item.starts_with("W/")) {
+      item.remove_prefix(2);
+    }
+    if (item == "*" || item == etag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string_view http::http_date_headers() {
+  static thread_local std::time_t last_time{ 0 };
+  static thread_local std::string headers{};
+
+  auto now = std::time(nullptr);
+  if (now != last_time) {
+    headers.clear(); // capacity is kept
+    headers += "Date: ";
+    headers += http_date(now);
+    headers += "\r\nServer: http-server\r\n";
+    last_time = now;
   }
+  return headers;
 }
 
 //---------------------------------------------------------------
\ No newline at end of file
@@ -14,7 +14,10 @@ static const llhttp_settings_t g_parser_settings{ get_http_parser_settings() };
 
 static llhttp_settings_t get_http_parser_settings() noexcept {
   return {
-    .on_message_begin = nullptr,
+    .on_message_begin = [](llhttp_t* http) -> int {
+      reinterpret_cast<HttpRequestParser*>(http->data)->started_ = true;
+      return 0;
+    },
 
     .on_url = [](llhttp_t* http, const char* at, size_t length) -> int {
       auto reader = reinterpret_cast<HttpRequestParser*>(http->data);
@@ -45,7 +48,10 @@ static llhttp_settings_t get_http_parser_settings() noexcept {
       return 0;
     },
 
-    .on_headers_complete = nullptr,
+    .on_headers_complete = [](llhttp_t* http) -> int {
+      reinterpret_cast<HttpRequestParser*>(http->data)->headers_done_ = true;
+      return 0;
+    },
 
     .on_body = [](llhttp_t* http, const char* at, size_t length) -> int {
       auto reader = reinterpret_cast<HttpRequestParser*>(http->data);
@@ -55,24 +61,15 @@ static llhttp_settings_t get_http_parser_settings() noexcept {
     },
 
     .on_message_complete = [](llhttp_t* http) -> int {
-      auto reader      = reinterpret_cast<HttpRequestParser*>(http->data);
-      auto method_name = llhttp_method_name((llhttp_method_t) http->method);
-      g_log->debug("[llhttp] method: {}", method_name);
-
-      if (strcmp(method_name, "GET") == 0) {
-        reader->request_.method = http::HttpMethod::GET;
-      } else if (strcmp(method_name, "POST") == 0) {
-        reader->request_.method = http::HttpMethod::POST;
-      } else {
-        g_log->error("[llhttp] unknown method: {}", method_name);
-        return -1;
-      }
+      auto reader             = reinterpret_cast<HttpRequestParser*>(http->data);
+      reader->request_.method = static_cast<HttpMethod>(http->method);
+      g_log->debug("[llhttp] method: {}", to_string(reader->request_.method));
 
       g_log->debug("[llhttp] message complete, execute handling");
 
-      auto content_type_it = reader->request_.headers.find(std::string{ HttpRequestHeaderKey::ContentType });
+      auto content_type_it = reader->request_.headers.find(HttpRequestHeaderKey::ContentType);
       if (content_type_it != reader->request_.headers.end()) {
-        auto content_type = content_type_it->second;
+        auto content_type = std::string_view{ content_type_it->second };
         auto body         = reader->body_parser_.parse(content_type);
         if (body) {
           reader->request_.body = std::move(body);
@@ -82,8 +79,9 @@ static llhttp_settings_t get_http_parser_settings() noexcept {
         }
       }
 
-      reader->done_ = true;
-      return 0;
+      reader->request_.keep_alive = llhttp_should_keep_alive(http) != 0;
+      reader->done_               = true;
+      return HPE_PAUSED; // one request at a time, pipelined data is parsed after response
     },
 
     .on_chunk_header          = nullptr,
@@ -94,35 +92,73 @@ static llhttp_settings_t get_http_parser_settings() noexcept {
 
     .on_header_value_complete = [](llhttp_t* http) -> int {
       auto reader = reinterpret_cast<HttpRequestParser*>(http->data);
-      reader->request_.headers.insert(std::make_pair(reader->last_header_field_, reader->last_header_value_));
+      reader->request_.headers.emplace(std::string_view{ reader->last_header_field_ }, std::string_view{ reader->last_header_value_ });
       g_log->debug(R"([llhttp] header "{}": "{}")", reader->last_header_field_, reader->last_header_value_);
-      reader->last_header_field_ = {};
-      reader->last_header_value_ = {};
+      reader->last_header_field_.clear(); // capacity is kept for next headers of connection
+      reader->last_header_value_.clear();
       return 0;
     },
   };
 }
 
-HttpRequestParser::HttpRequestParser() {
+//---------------------------------------------------------------
+
+HttpRequest::HttpRequest(Arena::Ptr arena)
+    : arena{ std::move(arena) }
+    , url{ this->arena->resource() }
+    , headers{ this->arena->resource() } {}
+
+HttpRequest& HttpRequest::operator=(HttpRequest&& other) noexcept {
+  // pmr containers take allocator only by construction, move assignment would copy into own arena.
+  // so they're reset and moved with other's allocator, own arena is released after them.
+  if (this != &other) {
+    std::destroy_at(&headers);
+    std::construct_at(&headers, std::move(other.headers));
+    std::destroy_at(&url);
+    std::construct_at(&url, std::move(other.url));
+    arena      = std::move(other.arena);
+    method     = other.method;
+    body       = std::move(other.body);
+    keep_alive = other.keep_alive;
+  }
+  return *this;
+}
+
+//---------------------------------------------------------------
+
+HttpRequestParser::HttpRequestParser()
+    : request_{ Arena::make() } {
   llhttp_init(&parser, HTTP_REQUEST, &g_parser_settings);
   parser.data = this;
 }
 
-bool HttpRequestParser::handle(char* data, size_t size) {
+bool HttpRequestParser::handle(const char* data, size_t size, size_t& consumed) {
   g_log->debug("http_tcp_read: {} bytes", size);
 
-  if (auto err = llhttp_execute(&parser, data, size); err != HPE_OK) {
-    g_log->error("http_tcp_read: parse error: %s %s\n", llhttp_errno_name(err), parser.reason);
-    return false;
-  }
-
-  if (done_) {
+  consumed = size;
+  auto err = llhttp_execute(&parser, data, size);
+  if (err == HPE_PAUSED && done_) {
+    consumed = static_cast<size_t>(llhttp_get_error_pos(&parser) - data);
     g_log->debug("http_tcp_read DONE");
+  } else if (err != HPE_OK) {
+    g_log->error("http_tcp_read: parse error: {} {}", llhttp_errno_name(err), parser.reason);
+    return false;
   }
 
   return true;
 }
 
+void HttpRequestParser::reset() {
+  done_              = false;
+  started_           = false;
+  headers_done_      = false;
+  request_           = HttpRequest{ Arena::make() };
+  last_header_field_.clear();
+  last_header_value_.clear();
+  body_parser_       = {};
+  llhttp_resume(&parser);
+}
+
 HttpRequestParser::~HttpRequestParser() {
   g_log->debug("~HttpRequestParser");
 }
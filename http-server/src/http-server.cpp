@@ -1,5 +1,8 @@
 #include "http-server/http-server.hpp"
+#include "http-server/handoff.hpp"
 #include "http-server/log.hpp"
+#include "http-server/scheduler.hpp"
+#include "http-server/uring-server.hpp"
 #include "http-server/utils.hpp"
 
 using namespace http;
@@ -41,64 +44,507 @@ HttpResponse& HttpResponse::with_default_status_message() {
   return *this << http_status_code_message(status_);
 }
 
-HttpResponse& HttpResponse::header(std::string key, std::string value) {
-  auto [it, ok] = headers_.try_emplace(std::move(key), std::move(value));
-  if (!ok) {
+HttpResponse& HttpResponse::stream(std::shared_ptr<HttpResponseStream> stream) {
+  stream_ = std::move(stream);
+  return *this;
+}
+
+HttpResponse& HttpResponse::send(std::shared_ptr<HttpResponseSender> sender) {
+  sender_ = std::move(sender);
+  return *this;
+}
+
+HttpResponse& HttpResponse::header(std::string_view key, std::string_view value) {
+  uint8_t default_header{ 0 };
+  if (iequals(key, HttpResponseHeaderKey::ContentType)) {
+    default_header = HasContentType;
+  } else if (iequals(key, HttpResponseHeaderKey::Connection)) {
+    default_header = HasConnection;
+  } else if (iequals(key, HttpResponseHeaderKey::TransferEncoding)) {
+    default_header = HasTransferEncoding;
+  } else if (iequals(key, HttpResponseHeaderKey::ContentLength)) {
+    default_header = HasContentLength;
+  } else if (iequals(key, HttpResponseHeaderKey::ContentEncoding)) {
+    default_header = HasContentEncoding;
+  }
+
+  if (default_header & default_headers_) {
     g_log->error("error adding header '{}': header with that key already present", key);
+    return *this;
   }
+  default_headers_ |= default_header;
+
+  headers_.reserve(headers_.size() + key.size() + value.size() + 4);
+  headers_ += key;
+  headers_ += ": ";
+  headers_ += value;
+  headers_ += "\r\n";
   return *this;
 }
 
-void HttpResponse::write(ITcpWriter* writer) {
-  static const std::string default_content_type{ Mime::combine(Mime::text_html, "charser=utf-8") };
+std::optional<std::string_view> HttpResponse::find_header(std::string_view key) const {
+  std::string_view headers{ headers_ };
+  while (!headers.empty()) {
+    auto line = headers.substr(0, headers.find("\r\n"));
+    headers.remove_prefix(std::min(line.size() + 2, headers.size()));
 
-  if (!headers_.contains("Content-Type")) {
-    headers_.emplace(HttpResponseHeaderKey::ContentType, default_content_type);
+    auto colon = line.find(':');
+    if (colon != std::string_view::npos && iequals(line.substr(0, colon), key)) {
+      return line.substr(std::min(colon + 2, line.size()));
+    }
   }
-  if (!headers_.contains("Connection")) {
-    headers_.emplace(HttpResponseHeaderKey::Connection, "close");
+  return std::nullopt;
+}
+
+bool HttpResponse::write(HttpResponseWriter* writer, CachedResponse* cached) {
+  static constexpr std::string_view default_content_type{ "text/html; charset=utf-8" };
+  static constexpr std::string_view transfer_encoding_chunked{ "Transfer-Encoding: chunked\r\n" };
+
+  auto code     = static_cast<int>(status_);
+  bool has_body = !(code < 200 || status_ == HttpStatusCode::NoContent || status_ == HttpStatusCode::NotModified);
+
+  if (default_headers_ & HasConnection) {
+    auto connection = find_header(HttpResponseHeaderKey::Connection);
+    if (connection && iequals(*connection, "close")) {
+      writer->keep_alive = false;
+    }
   }
 
-  writer->data << "HTTP/1.1 " << http_status_code_message(status_) << "\r\n";
+  writer->data << http_status_line(status_) << http_date_headers();
+  if (!(default_headers_ & HasConnection)) {
+    writer->data << http_connection_header(writer->keep_alive);
+  }
 
-  for (auto& [key, value] : headers_) {
-    writer->data << key << ": " << value << "\r\n";
+  // rest of headers doesn't depend on connection, so it's stored by response cache as is
+  std::string head{};
+  if (!(default_headers_ & HasContentType) && has_body) {
+    head += HttpResponseHeaderKey::ContentType;
+    head += ": ";
+    head += default_content_type;
+    head += "\r\n";
   }
 
-  writer->data << "\r\n";
+  // compressed if client accepts it and content is textual,
+  // falls back to identity if zlib fails
+  CompressorHandle compressor{};
+  if (writer->encoding != ContentEncoding::Identity && has_body && !sender_ && !(default_headers_ & HasContentEncoding)) {
+    auto content_type = default_headers_ & HasContentType ? find_header(HttpResponseHeaderKey::ContentType) : default_content_type;
+    if (content_type && is_compressible(*content_type) && (stream_ || message_.tellp() >= static_cast<std::streamoff>(writer->compression->min_size))) {
+      try {
+        compressor = CompressorPool::local().acquire(writer->encoding, writer->compression->level);
+      } catch (std::exception& ex) {
+        g_log->error("error compressing response: {}", ex.what());
+      }
+    }
+  }
+
+  // body framing: chunked for streams, length for buffered message and sender.
+  // for HEAD requests headers are the same as for GET, only body is omitted
+  std::string body{};
+  if (sender_ && has_body) {
+    if (!(default_headers_ & HasContentLength)) {
+      head += HttpResponseHeaderKey::ContentLength;
+      head += ": ";
+      head += std::to_string(sender_->length());
+      head += "\r\n";
+    }
+  } else if (stream_ && has_body) {
+    if (!(default_headers_ & HasTransferEncoding)) {
+      head += transfer_encoding_chunked;
+    }
+  } else if (has_body) {
+    if (has_message_) {
+      body = message_.str();
+    }
+    if (compressor) {
+      std::string compressed{};
+      try {
+        compressor->finish(body, compressed);
+        body = std::move(compressed);
+      } catch (std::exception& ex) {
+        g_log->error("error compressing response: {}", ex.what());
+        compressor.reset();
+      }
+    }
+    if (!(default_headers_ & HasContentLength)) {
+      head += HttpResponseHeaderKey::ContentLength;
+      head += ": ";
+      head += std::to_string(body.size());
+      head += "\r\n";
+    }
+  }
+  if (compressor) {
+    head += HttpResponseHeaderKey::ContentEncoding;
+    head += ": ";
+    head += to_string(compressor->encoding());
+    head += "\r\n";
+    head += HttpResponseHeaderKey::Vary;
+    head += ": ";
+    head += HttpRequestHeaderKey::AcceptEncoding;
+    head += "\r\n";
+  }
+  head += headers_;
+
+  bool captured = cached && capture(head, body, *cached);
+  writer->data << head << "\r\n";
+
+  if (sender_ && has_body && writer->with_body) {
+    writer->flush();
+    sender_->start(std::unique_ptr<HttpResponseWriter>{ writer });
+    return captured;
+  }
 
-  if (has_message_) {
-    writer->data << message_.str() << "\r\n";
+  if (stream_ && has_body && writer->with_body) {
+    writer->flush();
+    stream_->start(std::make_unique<HttpChunkWriter>(writer, std::move(compressor)));
+    return captured;
+  }
+
+  if (writer->with_body) {
+    writer->data << body;
   }
 
   writer->done();
   delete writer;
+  return captured;
+}
+
+bool HttpResponse::capture(std::string& head, const std::string& body, CachedResponse& cached) const {
+  // only complete buffered responses which are the same for everyone
+  if (stream_ || sender_ || (default_headers_ & HasConnection) ||
+      find_header(HttpResponseHeaderKey::SetCookie)) {
+    return false;
+  }
+  if (auto cache_control = find_header(HttpResponseHeaderKey::CacheControl);
+      cache_control && (cache_control->find("no-store") != std::string_view::npos || cache_control->find("private") != std::string_view::npos)) {
+    return false;
+  }
+
+  // strong validator of encoded body, so 304 could be answered from cache.
+  // errors are shared with waiters as is, they are never answered with 304
+  if (auto etag = find_header(HttpResponseHeaderKey::ETag); etag && status_ == HttpStatusCode::OK) {
+    cached.etag = *etag;
+  } else if (status_ == HttpStatusCode::OK) {
+    char etag_buffer[32]{};
+    auto crc    = crc32(0, reinterpret_cast<const Bytef*>(body.data()), static_cast<uInt>(body.size()));
+    int  length = std::snprintf(etag_buffer, sizeof(etag_buffer), "\"%zx-%lx\"", body.size(), static_cast<unsigned long>(crc));
+    cached.etag.assign(etag_buffer, static_cast<size_t>(std::max(length, 0)));
+
+    head += HttpResponseHeaderKey::ETag;
+    head += ": ";
+    head += cached.etag;
+    head += "\r\n";
+  }
+
+  std::string_view lines{ head };
+  while (!lines.empty()) {
+    auto end  = lines.find("\r\n");
+    auto line = lines.substr(0, end == std::string_view::npos ? end : end + 2);
+    lines.remove_prefix(line.size());
+    if (line.size() > HttpResponseHeaderKey::Vary.size() && iequals(line.substr(0, HttpResponseHeaderKey::Vary.size() + 1), "Vary:")) {
+      cached.vary += line;
+    }
+  }
+
+  cached.status = status_;
+  cached.head   = head;
+  cached.body   = body;
+  return true;
 }
 
 //---------------------------------------------------------------
 
-struct HttpTcpReader : public ITcpReader {
-  HttpServer*       server;
-  ITcpWriter*       writer;
-  HttpRequestParser parser;
-  bool              parse_error{ false };
+struct HttpConnectionWriter;
 
-  explicit HttpTcpReader(HttpServer* server, ITcpWriter* writer)
+//---------------------------------------------------------------
+// state of client connection, shared by reader and by writer of in-flight response.
+// requests are handled one at a time, pipelined requests wait in input.
+// one timeout per connection, its meaning depends on what connection waits for.
+struct http::HttpConnection : public std::enable_shared_from_this<HttpConnection> {
+  static constexpr size_t max_input_size{ 64 * 1024 }; // received but not parsed yet
+
+  enum class Phase : uint8_t {
+    Idle,     // between requests
+    Head,     // request line and headers
+    Body,     // request body
+    Response, // request is handled, write progress is checked
+  };
+
+  HttpServer*                 server;
+  std::unique_ptr<ITcpWriter> transport;
+  HttpRequestParser           parser{};
+  std::string                 input{};
+  bool                        in_flight{ false };  // request is being handled
+  bool                        closing{ false };    // nothing is parsed anymore
+  bool                        processing{ false }; // guards process() against reentrance
+  CancellationToken           cancellation{};
+  std::optional<std::string>  peer{};            // client address, resolved on first use
+  HttpConnectionWriter*       writer{ nullptr }; // of in-flight response
+  Scheduler::Timer            timeout{ [this] { on_timeout(); } };
+  Phase                       phase{ Phase::Idle };
+  size_t                      last_pending{ 0 }; // write queue and outstanding size at previous check
+  size_t                      outstanding{ 0 };  // body bytes of sender response which are not sent yet
+
+  HttpConnection(HttpServer* server, ITcpWriter* transport)
       : server{ server }
-      , writer{ writer } {}
+      , transport{ transport } {
+    server->connections_.insert(this);
+    update_timeout();
+  }
+
+  // handle is closed, object lives on while response writer holds it
+  void closed();
+
+  void read(const char* data, size_t size) {
+    if (closing) {
+      return;
+    }
+    if (input.size() + size > max_input_size) {
+      g_log->debug("http connection: too much pipelined data, closing");
+      close();
+      return;
+    }
+    if (input.empty()) {
+      process({ data, size });
+    } else {
+      input.append(data, size);
+      process();
+    }
+  }
+
+  void response_done(bool keep_alive) {
+    if (!keep_alive || closing || transport->closed() || server->draining_) {
+      close();
+      return;
+    }
+    transport->flush();
+    if (server->connection_settings_.cork) {
+      transport->cork(false); // rest of response goes out with flush
+    }
+    in_flight = false;
+    parser.reset();
+    process();
+  }
 
-  ~HttpTcpReader() override { g_log->debug("~HttpTcpReader"); }
+  void close() {
+    closing = true;
+    transport->done(); // closes handle after write queue is drained
+    update_timeout();
+  }
+
+  // server shuts down: idle connection is closed, in-flight response becomes the last one
+  void drain() {
+    if (closing) {
+      return;
+    }
+    if (!in_flight) {
+      close();
+    } else if (writer) {
+      writer->keep_alive = false;
+    }
+  }
+
+private:
+  // data is read buffer, it's parsed in place while nothing is buffered before it,
+  // only its unparsed rest is copied to input since buffer is reused after read
+  void process(std::string_view data = {}) {
+    if (processing) {
+      input.append(data);
+      return; // response was finished synchronously, outer loop continues
+    }
+    processing = true;
+    while (!in_flight && !closing && !(data.empty() && input.empty())) {
+      auto   source = data.empty() ? std::string_view{ input } : data;
+      size_t consumed{ 0 };
+      bool   ok = parser.handle(source.data(), source.size(), consumed);
+      if (data.empty()) {
+        input.erase(0, consumed);
+      } else {
+        data.remove_prefix(consumed);
+      }
 
-  void read(char* data, size_t size) override {
-    if (!parser.done_) {
-      if (!parse_error && !parser.handle(data, size)) {
-        parse_error = true;
-        server->_handle_request_parse_error(writer);
+      if (!ok) {
+        in_flight = closing = true;
+        server->_handle_request_parse_error(make_writer(false, true));
       } else if (parser.done_) {
-        server->_handle_request(std::move(parser.request_), writer);
+        in_flight   = true;
+        auto writer = make_writer(parser.request_.keep_alive && !server->draining_, parser.request_.method != HttpMethod::HEAD);
+        if (server->rate_limiter_) {
+          if (!peer) {
+            peer = transport->peer();
+          }
+          if (server->_limit_rate(parser.request_, *peer, writer)) {
+            continue;
+          }
+        }
+        cancellation = CancellationToken::make();
+        server->_handle_request(std::move(parser.request_), writer, cancellation);
       }
     }
+    if (!closing) {
+      input.append(data); // pipelined requests
+    }
+    processing = false;
+    update_timeout();
+  }
+
+  void update_timeout() {
+    auto& settings = server->connection_settings_;
+    if (in_flight || (closing && transport->pending() != 0)) {
+      set_phase(Phase::Response, settings.write_timeout);
+    } else if (closing) {
+      timeout.cancel();
+    } else if (parser.headers_done_) {
+      set_phase(Phase::Body, settings.body_timeout);
+    } else if (parser.started_ || !input.empty()) {
+      set_phase(Phase::Head, settings.header_timeout);
+    } else {
+      set_phase(Phase::Idle, settings.idle_timeout);
+    }
+  }
+
+  // deadline is counted from start of phase, so trickling bytes doesn't extend it
+  void set_phase(Phase next, std::chrono::milliseconds delay) {
+    if (phase == next && timeout.armed()) {
+      return;
+    }
+    phase        = next;
+    last_pending = pending();
+    if (delay.count() != 0) {
+      timeout.start(delay);
+    } else {
+      timeout.cancel();
+    }
   }
+
+  void on_timeout() {
+    if (transport->closed()) {
+      return;
+    }
+    switch (phase) {
+      case Phase::Idle:
+        g_log->debug("http connection: idle timeout, closing");
+        close();
+        break;
+      case Phase::Head:
+      case Phase::Body:
+        g_log->debug("http connection: request timeout, closing");
+        in_flight = closing = true;
+        server->_handle_request_timeout(make_writer(false, true));
+        break;
+      case Phase::Response:
+        if (auto pending = this->pending(); pending != 0 && pending >= last_pending) {
+          g_log->debug("http connection: client doesn't read response, closing");
+          closing = true;
+          transport->abort();
+        } else {
+          last_pending = pending;
+          timeout.start(server->connection_settings_.write_timeout);
+        }
+        break;
+    }
+  }
+
+  HttpResponseWriter* make_writer(bool keep_alive, bool with_body);
+
+  [[nodiscard]] size_t pending() const { return transport->pending() + outstanding; }
+};
+
+//---------------------------------------------------------------
+// response data goes to connection transport, finishing response
+// either closes connection or starts handling next request.
+struct HttpConnectionWriter : public HttpResponseWriter {
+  std::shared_ptr<HttpConnection> connection;
+  bool                            finished{ false };
+  std::function<void()>           close_callback{};
+
+  HttpConnectionWriter(std::shared_ptr<HttpConnection> connection, bool keep_alive, bool with_body)
+      : connection{ std::move(connection) } {
+    this->keep_alive = keep_alive;
+    this->with_body  = with_body;
+  }
+
+  ~HttpConnectionWriter() override {
+    if (connection->writer == this) {
+      connection->writer = nullptr;
+    }
+    if (!finished) {
+      connection->close();
+    }
+  }
+
+  void done() override {
+    if (finished) {
+      return;
+    }
+    finished                = true;
+    connection->outstanding = 0;
+    flush();
+    connection->response_done(keep_alive);
+  }
+
+  void flush() override {
+    // transport data is always flushed, so streams are swapped without copying
+    data.swap(connection->transport->data);
+    connection->transport->flush();
+  }
+
+  size_t pending() const override { return connection->transport->pending(); }
+  bool   closed() const override { return connection->transport->closed(); }
+  void   on_drain(std::function<void()> cb) override { connection->transport->on_drain(std::move(cb)); }
+  int    fd() const override { return connection->transport->fd(); }
+  void   outstanding(size_t bytes) override { connection->outstanding = bytes; }
+
+  void on_close(std::function<void()> cb) override {
+    if (closed()) {
+      cb();
+    } else {
+      close_callback = std::move(cb);
+    }
+  }
+
+  // callback could finish response and delete writer
+  void notify_closed() {
+    if (close_callback && !finished) {
+      auto callback = std::move(close_callback);
+      close_callback = nullptr;
+      callback();
+    }
+  }
+};
+
+void HttpConnection::closed() {
+  closing = true;
+  if (writer) {
+    writer->notify_closed(); // e.g. stream stops producer which waits for client
+  }
+  timeout.cancel();
+  cancellation.cancel(); // nobody waits for response
+  server->remove_connection(this);
+}
+
+HttpResponseWriter* HttpConnection::make_writer(bool keep_alive, bool with_body) {
+  if (server->connection_settings_.cork) {
+    transport->cork(true);
+  }
+  writer = new HttpConnectionWriter(shared_from_this(), keep_alive, with_body);
+  return writer;
+}
+
+//---------------------------------------------------------------
+
+struct HttpTcpReader : public ITcpReader {
+  std::shared_ptr<HttpConnection> connection;
+
+  explicit HttpTcpReader(HttpServer* server, ITcpWriter* writer)
+      : connection{ std::make_shared<HttpConnection>(server, writer) } {}
+
+  ~HttpTcpReader() override {
+    g_log->debug("~HttpTcpReader");
+    connection->closed();
+  }
+
+  void read(char* data, size_t size) override { connection->read(data, size); }
 };
 
 //---------------------------------------------------------------
@@ -116,38 +562,333 @@ struct HttpTcpReaderFactory : public ITcpReaderFactory {
 
 //---------------------------------------------------------------
 
-HttpServer::HttpServer()
+static std::unique_ptr<ITcpServer> make_tcp_server(NetworkBackend backend, HttpServer* server) {
+#ifdef HTTP_SERVER_IO_URING
+  if (backend == NetworkBackend::IoUring) {
+    if (auto uring = UringServer::create(std::make_unique<HttpTcpReaderFactory>(server))) {
+      return uring;
+    }
+    g_log->warn("io_uring is not available, libuv is used");
+  }
+#else
+  if (backend == NetworkBackend::IoUring) {
+    g_log->warn("built without io_uring support, libuv is used");
+  }
+#endif
+  return std::make_unique<TcpServer>(std::make_unique<HttpTcpReaderFactory>(server));
+}
+
+HttpServer::HttpServer(NetworkBackend backend)
     : make_not_found_handler_{ [] {
       return new DefaultNotFoundHandler();
     } }
     , make_bad_request_handler_{ [] {
       return new DefaultBadRequestHandler();
     } }
-    , tcp_{ std::make_unique<HttpTcpReaderFactory>(this) } {}
+    , tcp_{ make_tcp_server(backend, this) } {}
 
 void HttpServer::listen(const char* addr, int port) {
   g_log->info("http server listening on {}:{}", addr, port);
-  tcp_.listen(addr, port);
+  tcp_->listen(addr, port);
+}
+
+void HttpServer::listen_unix(const std::string& path) {
+  g_log->info("http server listening on unix socket {}", path);
+  tcp_->listen_unix(path);
+}
+
+bool HttpServer::listen_handoff(const std::string& path) {
+  int socket = handoff::connect(path);
+  if (socket < 0) {
+    return false;
+  }
+
+  auto fds = handoff::receive(socket);
+  if (fds.empty()) {
+    handoff::close(socket); // old process keeps serving
+    return false;
+  }
+
+  g_log->info("http server listening on socket handed off by previous process");
+  tcp_->listen(fds.front());
+  for (size_t i = 1; i < fds.size(); i++) {
+    handoff::close(fds[i]); // single listener per server
+  }
+  handoff::confirm(socket);
+  return true;
+}
+
+void HttpServer::serve_handoff(const std::string& path, std::chrono::milliseconds deadline, std::function<void()> on_done) {
+  handoff_ = uvw::Loop::getDefault()->resource<uvw::PipeHandle>();
+  handoff_->on<uvw::ErrorEvent>([path](const uvw::ErrorEvent& err, uvw::PipeHandle&) {
+    g_log->error("handoff: error on {}: {}", path, err.what());
+  });
+
+  auto on_done_ptr = std::make_shared<std::function<void()>>(std::move(on_done));
+  handoff_->on<uvw::ListenEvent>([this, path, deadline, on_done_ptr](const uvw::ListenEvent&, uvw::PipeHandle& handle) {
+    auto peer = handle.loop().resource<uvw::PipeHandle>();
+    handle.accept(*peer);
+
+    int fd = tcp_->fd();
+    if (fd < 0 || !handoff::send(static_cast<int>(peer->fd()), { fd })) {
+      peer->close();
+      return;
+    }
+
+    // new process listens, this one drains
+    peer->once<uvw::DataEvent>([this, path, deadline, on_done_ptr](const uvw::DataEvent&, uvw::PipeHandle& peer) {
+      g_log->info("handoff: listening socket is taken over by new process");
+      peer.close();
+      handoff_->close();
+      handoff::unlink(path, handoff_inode_);
+      shutdown(deadline, std::move(*on_done_ptr));
+    });
+    peer->once<uvw::EndEvent>([](const uvw::EndEvent&, uvw::PipeHandle& peer) {
+      g_log->error("handoff: new process has gone before listening");
+      peer.close();
+    });
+    peer->read();
+  });
+
+  remove_stale_unix_socket(path); // left by crashed process
+  handoff_->bind(path);
+  handoff_->listen();
+  handoff_inode_ = handoff::inode(path);
+  handoff_->unreference(); // waiting for new process should not keep loop running
+}
+
+void HttpServer::shutdown(std::chrono::milliseconds deadline, std::function<void()> on_done) {
+  if (draining_) {
+    return;
+  }
+  g_log->info("http server shutting down, {} connections open", connections_.size());
+  draining_    = true;
+  on_shutdown_ = std::move(on_done);
+  tcp_->close();
+
+  for (auto connection : connections_) {
+    connection->drain(); // closing is asynchronous, so set isn't changed meanwhile
+  }
+  if (connections_.empty()) {
+    finish_shutdown();
+  } else {
+    shutdown_deadline_.start(deadline);
+  }
+}
+
+void HttpServer::shutdown_on_signals(std::chrono::milliseconds deadline, std::function<void()> on_done) {
+  auto on_done_ptr = std::make_shared<std::function<void()>>(std::move(on_done));
+  for (int signum : { SIGTERM, SIGINT }) {
+    auto signal = uvw::Loop::getDefault()->resource<uvw::SignalHandle>();
+    signal->on<uvw::SignalEvent>([this, deadline, on_done_ptr](const uvw::SignalEvent& event, uvw::SignalHandle&) {
+      if (draining_) {
+        g_log->info("http server got signal {} again, dropping connections", event.signum);
+        drop_connections();
+      } else {
+        g_log->info("http server got signal {}", event.signum);
+        shutdown(deadline, std::move(*on_done_ptr));
+      }
+    });
+    signal->start(signum);
+    signal->unreference(); // waiting for signal should not keep loop running
+    signals_.push_back(std::move(signal));
+  }
+}
+
+void HttpServer::remove_connection(HttpConnection* connection) {
+  connections_.erase(connection);
+  if (draining_ && connections_.empty()) {
+    finish_shutdown();
+  }
+}
+
+void HttpServer::finish_shutdown() {
+  g_log->info("http server is shut down");
+  shutdown_deadline_.cancel();
+  for (auto& signal : signals_) {
+    signal->close();
+  }
+  signals_.clear();
+  if (auto on_done = std::move(on_shutdown_)) {
+    on_shutdown_ = nullptr;
+    on_done();
+  }
+}
+
+void HttpServer::drop_connections() {
+  g_log->info("http server drops {} connections", connections_.size());
+  for (auto connection : connections_) {
+    connection->closing = true;
+    connection->transport->abort(); // reader is destroyed on close, so handler is cancelled
+  }
+}
+
+void HttpServer::set_connection_settings(ConnectionSettings settings) {
+  connection_settings_ = settings;
+  tcp_->set_max_connections(settings.max_connections);
+  tcp_->set_no_delay(settings.no_delay);
+}
+
+void HttpServer::set_rate_limit(RateLimitSettings settings) {
+  rate_limiter_ = settings.rate > 0 ? std::make_unique<RateLimiter>(std::move(settings)) : nullptr;
+}
+
+HttpServer::Handler* HttpServer::find_handler(HttpMethod method, std::string_view path) {
+  for (auto& handler : handlers_[static_cast<size_t>(method)]) {
+    if (handler.matches(path)) {
+      return &handler;
+    }
+  }
+  return nullptr;
+}
+
+std::string HttpServer::allowed_methods(std::string_view path) const {
+  std::array<bool, http_methods_count> allowed{};
+  bool                                 any{ false };
+
+  for (size_t method = 0; method < http_methods_count; method++) {
+    for (auto& handler : handlers_[method]) {
+      if (path == "*" || handler.matches(path)) {
+        allowed[method] = any = true;
+        break;
+      }
+    }
+  }
+  if (!any) {
+    return {};
+  }
+
+  // served automatically
+  constexpr auto get     = static_cast<size_t>(HttpMethod::GET);
+  constexpr auto head    = static_cast<size_t>(HttpMethod::HEAD);
+  constexpr auto options = static_cast<size_t>(HttpMethod::OPTIONS);
+  allowed[head]    = allowed[head] || allowed[get];
+  allowed[options] = true;
+
+  std::string result;
+  for (size_t method = 0; method < http_methods_count; method++) {
+    if (allowed[method]) {
+      if (!result.empty()) {
+        result += ", ";
+      }
+      result += to_string(static_cast<HttpMethod>(method));
+    }
+  }
+  return result;
+}
+
+void HttpServer::negotiate_compression(HttpResponseWriter& writer, const HttpRequest& request, bool allow_compression) const {
+  if (!compression_.enabled || !allow_compression) {
+    return;
+  }
+  auto accept_encoding = request.headers.find(HttpRequestHeaderKey::AcceptEncoding);
+  if (accept_encoding != request.headers.end()) {
+    writer.encoding    = negotiate_content_encoding(accept_encoding->second);
+    writer.compression = &compression_;
+  }
+}
+
+bool HttpServer::_limit_rate(const HttpRequest& request, const std::string& peer, HttpResponseWriter* writer) {
+  std::string_view key = peer;
+  if (auto& header = rate_limiter_->settings().key_header; !header.empty()) {
+    if (auto it = request.headers.find(header); it != request.headers.end()) {
+      key = it->second;
+    }
+  }
+
+  std::chrono::seconds retry_after{};
+  if (rate_limiter_->try_acquire(key, retry_after)) {
+    return false;
+  }
+  g_log->debug("error handling request: rate limit exceeded by '{}'", peer);
+  write_overloaded(writer, HttpStatusCode::TooManyRequests, retry_after);
+  return true;
 }
 
-void HttpServer::_handle_request(HttpRequest request, ITcpWriter* writer) {
-  HttpRequestHandler* request_handler{ nullptr };
-  std::smatch         matches;
+void HttpServer::_handle_request(HttpRequest request, HttpResponseWriter* writer, CancellationToken cancellation, bool coalesce) {
+  auto handler = find_handler(request.method, request.path());
+  if (!handler && request.method == HttpMethod::HEAD) {
+    handler = find_handler(HttpMethod::GET, request.path()); // response body is dropped
+  }
+
+  // key of response for cache and for coalescing of identical requests,
+  // url selects route and its params
+  std::string                key{};
+  const ResponseCachePolicy* cache_policy{ nullptr };
+  bool                       cacheable_method = request.method == HttpMethod::GET || request.method == HttpMethod::HEAD;
+  if (handler && cacheable_method) {
+    if (handler->cache && handler->cache->ttl.count() > 0 && response_cache_) {
+      cache_policy = handler->cache;
+    }
+    // route without ttl could still declare vary headers, cookies select per user response unless varied on
+    static const ResponseCachePolicy no_vary{};
+    const auto&                      key_policy = handler->cache ? *handler->cache : no_vary;
 
-  for (auto& handler : handlers_) {
-    if (handler.method == request.method && std::regex_match(request.url, matches, handler.url_match)) {
-      request_handler     = handler.construct();
-      request.url_matches = matches;
-      break;
+    coalesce = coalesce && handler->coalesce &&
+               (key_policy.varies(HttpRequestHeaderKey::Cookie) || !request.headers.contains(HttpRequestHeaderKey::Cookie));
+    if (cache_policy || coalesce) {
+      negotiate_compression(*writer, request, handler->allow_compression);
+      key = ResponseCache::make_key(request, key_policy, writer->encoding);
     }
   }
 
+  // cached responses are written without constructing handler
+  if (auto cached = cache_policy && !key.empty() ? response_cache_->find(key) : nullptr) {
+    auto if_none_match = request.headers.find(HttpRequestHeaderKey::IfNoneMatch);
+    cached->write(writer, if_none_match != request.headers.end() && etag_matches(if_none_match->second, cached->etag));
+    return;
+  }
+
+  // identical request is in flight, response is copied when it's ready
+  if (coalesce && !key.empty()) {
+    if (auto it = coalesced_.find(key); it != coalesced_.end()) {
+      it->second.push_back(CoalescedRequest{ std::move(request), writer, std::move(cancellation) });
+      return;
+    }
+  }
+
+  // load shedding: route limit is checked first, so busy route doesn't take slots of others
+  AdmissionControl::Clock::time_point admitted_at{};
+  if (handler) {
+    if (handler->max_in_flight != 0 && handler->in_flight >= handler->max_in_flight) {
+      g_log->debug("error handling request: too many requests in flight for '{}'", request.url);
+      write_overloaded(writer, HttpStatusCode::TooManyRequests, admission_.settings().retry_after);
+      return;
+    }
+    if (!admission_.try_acquire()) {
+      g_log->debug("error handling request: server is overloaded, {} requests in flight", admission_.in_flight());
+      write_overloaded(writer, HttpStatusCode::ServiceUnavailable, admission_.settings().retry_after);
+      return;
+    }
+    handler->in_flight++;
+    admitted_at = AdmissionControl::Clock::now();
+  }
+
+  auto request_handler = handler ? handler->construct(request) : nullptr;
+
   if (!request_handler) {
+    release_admission(handler, admitted_at);
+    handler = nullptr;
+
+    if (auto allowed = allowed_methods(request.path()); !allowed.empty()) {
+      HttpResponse response{};
+      if (request.method == HttpMethod::OPTIONS) {
+        response.status(HttpStatusCode::NoContent);
+      } else {
+        g_log->debug("error handling request: method {} is not allowed for '{}'", to_string(request.method), request.url);
+        response.status(HttpStatusCode::MethodNotAllowed).with_default_status_message();
+      }
+      response.header(HttpResponseHeaderKey::Allow, allowed);
+      response.write(writer);
+      return;
+    }
+
     g_log->debug("error handling request: no such handler for '{}'", request.url);
-    request_handler = make_not_found_handler_();
+    request_handler          = make_not_found_handler_();
+    request_handler->request = std::move(request);
   }
 
-  request_handler->request = std::move(request);
+  request_handler->cancellation = cancellation;
 
   bool preprocess_ok = false;
   try {
@@ -160,38 +901,105 @@ void HttpServer::_handle_request(HttpRequest request, ITcpWriter* writer) {
     g_log->debug("error handling request: preprocess error");
     request = std::move(request_handler->request);
     delete request_handler;
-    request_handler          = make_bad_request_handler_();
-    request_handler->request = std::move(request);
+    request_handler               = make_bad_request_handler_();
+    request_handler->request      = std::move(request);
+    request_handler->cancellation = std::move(cancellation);
+    key.clear();
+  }
+
+  coalesce = coalesce && !key.empty();
+  if (coalesce) {
+    // other clients wait for this handler, so it's not cancelled when this client disconnects
+    coalesced_.try_emplace(key);
+    request_handler->cancellation = CancellationToken::make();
   }
 
   request_handler->handle()
-      .then([writer, request_handler](HttpResponse response) mutable {
+      .then([this, writer, request_handler, handler, admitted_at, key, cache_policy, coalesce](HttpResponse response) mutable {
+        negotiate_compression(*writer, request_handler->request, request_handler->allow_compression);
         request_handler->destroy();
-        response.write(writer);
+        release_admission(handler, admitted_at);
+        complete_request(response, writer, key, cache_policy, coalesce);
       })
-      .fail(http::unwrap_exception_ptr([writer](const std::exception& ex) {
+      .fail(http::unwrap_exception_ptr([this, writer, request_handler, handler, admitted_at, key, coalesce](const std::exception& ex) {
         http::HttpResponse response{};
         g_log->debug("error while handling request: {}", ex.what());
+        request_handler->destroy();
+        release_admission(handler, admitted_at);
         response.status(http::HttpStatusCode::InternalServerError).with_default_status_message();
-        response.write(writer);
+        complete_request(response, writer, key, nullptr, coalesce);
       }));
 }
 
-void HttpServer::_handle_request_parse_error(ITcpWriter* writer) {
+void HttpServer::complete_request(HttpResponse& response, HttpResponseWriter* writer, const std::string& key,
+                                  const ResponseCachePolicy* cache_policy, bool coalesce) {
+  if (!cache_policy && !coalesce) {
+    response.write(writer);
+    return;
+  }
+
+  if (cache_policy && !cache_policy->vary.empty()) {
+    std::string vary{};
+    for (auto& header : cache_policy->vary) {
+      vary += vary.empty() ? "" : ", ";
+      vary += header;
+    }
+    response.header(HttpResponseHeaderKey::Vary, vary);
+  }
+
+  CachedResponse shared{};
+  bool           is_shared = response.write(writer, &shared);
+
+  // waiters get copy of response, or are handled one by one if it can't be shared
+  auto waiters = coalesce ? coalesced_.extract(key) : decltype(coalesced_)::node_type{};
+  for (size_t i = 0; waiters && i < waiters.mapped().size(); i++) {
+    auto& waiter = waiters.mapped()[i];
+    if (is_shared) {
+      auto if_none_match = waiter.request.headers.find(HttpRequestHeaderKey::IfNoneMatch);
+      bool not_modified  = shared.status == HttpStatusCode::OK && if_none_match != waiter.request.headers.end() &&
+                          etag_matches(if_none_match->second, shared.etag);
+      shared.write(waiter.writer, not_modified);
+    } else {
+      _handle_request(std::move(waiter.request), waiter.writer, std::move(waiter.cancellation), false);
+    }
+  }
+
+  if (cache_policy && is_shared && shared.status == HttpStatusCode::OK) {
+    shared.expires_at = CachedResponse::Clock::now() + cache_policy->ttl;
+    response_cache_->insert(key, std::move(shared));
+  }
+}
+
+void HttpServer::release_admission(Handler* handler, AdmissionControl::Clock::time_point admitted_at) {
+  if (handler) {
+    handler->in_flight--;
+    admission_.release(admitted_at);
+  }
+}
+
+void HttpServer::write_overloaded(HttpResponseWriter* writer, HttpStatusCode status, std::chrono::seconds retry_after) {
+  writer->data << http_status_line(status) << http_date_headers() << http_connection_header(writer->keep_alive)
+               << HttpResponseHeaderKey::RetryAfter << ": " << retry_after.count() << "\r\n"
+               << HttpResponseHeaderKey::ContentLength << ": 0\r\n\r\n";
+  writer->done();
+  delete writer;
+}
+
+void HttpServer::_handle_request_parse_error(HttpResponseWriter* writer) {
   g_log->debug("handling request parse error answer");
   auto request_handler = make_bad_request_handler_();
   request_handler->handle()
-      .then([writer, request_handler](HttpResponse response) mutable {
+      .then([this, writer, request_handler](HttpResponse response) mutable {
+        negotiate_compression(*writer, request_handler->request, request_handler->allow_compression);
         request_handler->destroy();
         response.write(writer);
       });
 }
 
-std::regex HttpServer::preprocess_regex(const std::string& str) {
-  std::string result{ "^" + str + "$" };
-  result = replace_all(result, "{int}", "(\\d+)");
-  result = replace_all(result, "{string}", "([^\\/]+)");
-  return std::regex(result);
+void HttpServer::_handle_request_timeout(HttpResponseWriter* writer) {
+  HttpResponse response{};
+  response.status(HttpStatusCode::RequestTimeout).with_default_status_message();
+  response.write(writer);
 }
 
 //---------------------------------------------------------------
@@ -205,3 +1013,17 @@ HttpRequestHandler::~HttpRequestHandler() {
 }
 
 //---------------------------------------------------------------
+
+HttpRequestHandler::HandleResult HttpCoroutineHandler::handle() {
+  return cti::make_continuable<HttpResponse>([this](cti::promise<HttpResponse>&& promise) {
+    spawn(handle_async(), [promise = std::move(promise)](detail::SpawnResult<HttpResponse> response, std::exception_ptr ex) mutable {
+      if (ex) {
+        promise.set_exception(std::move(ex));
+      } else {
+        promise.set_value(std::move(*response));
+      }
+    });
+  });
+}
+
+//---------------------------------------------------------------
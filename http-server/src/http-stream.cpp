@@ -0,0 +1,86 @@
+#include "http-server/http-stream.hpp"
+#include "http-server/log.hpp"
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+HttpChunkWriter::~HttpChunkWriter() {
+  if (writer_) {
+    g_log->debug("chunk writer destroyed before end of response");
+    abort();
+  }
+}
+
+static void write_chunk(ITcpWriter* writer, std::string_view chunk) {
+  if (!chunk.empty()) {
+    writer->data << std::hex << chunk.size() << std::dec << "\r\n"
+                 << chunk << "\r\n";
+  }
+}
+
+void HttpChunkWriter::write(std::string_view chunk) {
+  if (!writer_ || chunk.empty()) {
+    return;
+  }
+  if (compressor_) {
+    compressed_.clear();
+    try {
+      compressor_->write(chunk, compressed_);
+    } catch (std::exception& ex) {
+      g_log->error("chunk writer: {}", ex.what());
+      abort();
+      return;
+    }
+    chunk = compressed_;
+  }
+  write_chunk(writer_, chunk);
+  writer_->flush();
+}
+
+void HttpChunkWriter::end() {
+  if (!writer_) {
+    return;
+  }
+  if (compressor_) {
+    compressed_.clear();
+    try {
+      compressor_->finish({}, compressed_);
+    } catch (std::exception& ex) {
+      g_log->error("chunk writer: {}", ex.what());
+      abort();
+      return;
+    }
+    compressor_.reset();
+    write_chunk(writer_, compressed_);
+  }
+  writer_->data << "0\r\n\r\n";
+  writer_->done();
+  delete writer_;
+  writer_ = nullptr;
+}
+
+void HttpChunkWriter::abort() {
+  if (!writer_) {
+    return;
+  }
+  writer_->keep_alive = false; // client can't tell where truncated body ends
+  compressor_.reset();
+  writer_->done();
+  delete writer_;
+  writer_ = nullptr;
+}
+
+void HttpChunkWriter::on_drain(std::function<void()> cb) {
+  if (writer_) {
+    writer_->on_drain(std::move(cb));
+  }
+}
+
+void HttpChunkWriter::on_close(std::function<void()> cb) {
+  if (writer_) {
+    writer_->on_close(std::move(cb));
+  }
+}
+
+//---------------------------------------------------------------
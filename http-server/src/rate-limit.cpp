@@ -0,0 +1,82 @@
+#include "http-server/rate-limit.hpp"
+#include "http-server/log.hpp"
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+RateLimiter::RateLimiter(RateLimitSettings settings)
+    : settings_{ std::move(settings) } {
+  settings_.burst = std::max(settings_.burst, 1.0);
+
+  auto interval = std::max(settings_.sweep_interval, std::chrono::milliseconds{ 10 });
+  sweeper_      = uvw::Loop::getDefault()->resource<uvw::TimerHandle>();
+  sweeper_->on<uvw::TimerEvent>([this](const uvw::TimerEvent&, uvw::TimerHandle&) {
+    if (auto swept = sweep()) {
+      g_log->debug("rate limiter evicted {} idle clients", swept);
+    }
+  });
+  sweeper_->start(interval, interval);
+  sweeper_->unreference(); // sweeper alone should not keep loop running
+}
+
+RateLimiter::~RateLimiter() {
+  sweeper_->close();
+}
+
+bool RateLimiter::try_acquire(std::string_view key, std::chrono::seconds& retry_after) {
+  auto& shard = shards_[StringHash{}(key) % shards_count];
+  auto  now   = now_ms();
+
+  // key is copied only for new client
+  auto it       = shard.find(key);
+  bool inserted = it == shard.end();
+  if (inserted) {
+    it = shard.emplace(std::string{ key }, Bucket{ static_cast<float>(settings_.burst), now }).first;
+  }
+  auto& bucket = it->second;
+  if (!inserted) {
+    // unsigned difference stays correct when milliseconds counter wraps
+    auto elapsed      = static_cast<double>(now - bucket.updated_ms) / 1000.0;
+    bucket.tokens     = static_cast<float>(std::min(settings_.burst, bucket.tokens + elapsed * settings_.rate));
+    bucket.updated_ms = now;
+  }
+
+  if (bucket.tokens >= 1) {
+    bucket.tokens -= 1;
+    return true;
+  }
+  retry_after = std::chrono::seconds{ static_cast<int64_t>(std::ceil((1 - bucket.tokens) / settings_.rate)) };
+  return false;
+}
+
+size_t RateLimiter::sweep() {
+  auto&  shard   = shards_[next_sweep_];
+  auto   now     = now_ms();
+  auto   idle    = idle_ms();
+  size_t dropped = 0;
+  next_sweep_    = (next_sweep_ + 1) % shards_count;
+
+  for (auto it = shard.begin(); it != shard.end();) {
+    if (now - it->second.updated_ms >= idle) {
+      it = shard.erase(it);
+      dropped++;
+    } else {
+      ++it;
+    }
+  }
+  return dropped;
+}
+
+uint32_t RateLimiter::now_ms() const {
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_);
+  return static_cast<uint32_t>(elapsed.count());
+}
+
+uint32_t RateLimiter::idle_ms() const {
+  // tiny rate overflows uint32_t milliseconds (zero rate gives infinity), such buckets are kept for max time
+  auto ms = std::ceil(settings_.burst / settings_.rate * 1000.0);
+  return static_cast<uint32_t>(std::min<double>(std::numeric_limits<uint32_t>::max(), ms));
+}
+
+//---------------------------------------------------------------
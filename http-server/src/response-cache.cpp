@@ -0,0 +1,83 @@
+#include "http-server/response-cache.hpp"
+#include "http-server/utils.hpp"
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+void CachedResponse::write(HttpResponseWriter* writer, bool not_modified) const {
+  writer->data << http_status_line(not_modified ? HttpStatusCode::NotModified : status) << http_date_headers()
+               << http_connection_header(writer->keep_alive);
+  if (not_modified) {
+    writer->data << HttpResponseHeaderKey::ETag << ": " << etag << "\r\n"
+                 << vary << "\r\n";
+  } else {
+    writer->data << head << "\r\n";
+    if (writer->with_body) {
+      writer->data << body;
+    }
+  }
+
+  writer->done();
+  delete writer;
+}
+
+//---------------------------------------------------------------
+
+std::string ResponseCache::make_key(const HttpRequest& request, const ResponseCachePolicy& policy, ContentEncoding encoding) {
+  // responses for authorized requests are private unless route varies on Authorization
+  if (!policy.varies(HttpRequestHeaderKey::Authorization) && request.headers.contains(HttpRequestHeaderKey::Authorization)) {
+    return {};
+  }
+
+  // HEAD is answered from GET response
+  std::string key{ request.url };
+  key += '\n';
+  key += to_string(encoding);
+  for (auto& header : policy.vary) {
+    key += '\n';
+    if (auto it = request.headers.find(header); it != request.headers.end()) {
+      key += it->second;
+    }
+  }
+  return key;
+}
+
+const CachedResponse* ResponseCache::find(const std::string& key) {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  if (it->second.response.expires_at <= CachedResponse::Clock::now()) {
+    erase(key);
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru);
+  return &it->second.response;
+}
+
+void ResponseCache::insert(const std::string& key, CachedResponse response) {
+  if (key.size() + response.size() > settings_.max_entry_size) {
+    return;
+  }
+  erase(key);
+
+  size_ += key.size() + response.size();
+  lru_.push_front(key);
+  entries_.emplace(key, Entry{ std::move(response), lru_.begin() });
+
+  while (size_ > settings_.max_size) {
+    erase(lru_.back());
+  }
+}
+
+void ResponseCache::erase(const std::string& key) {
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    size_ -= key.size() + it->second.response.size();
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+  }
+}
+
+//---------------------------------------------------------------
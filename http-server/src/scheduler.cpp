@@ -0,0 +1,106 @@
+#include "http-server/scheduler.hpp"
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+void Scheduler::Timer::start(std::chrono::milliseconds delay) {
+  auto& scheduler = local();
+  scheduler.remove(this);
+  scheduler.add(this, delay);
+}
+
+void Scheduler::Timer::cancel() {
+  if (armed()) {
+    local().remove(this);
+  }
+}
+
+//---------------------------------------------------------------
+
+Scheduler& Scheduler::local() {
+  static thread_local Scheduler scheduler;
+  return scheduler;
+}
+
+void Scheduler::post(std::function<void()> callback) {
+  if (!idle_) {
+    idle_ = uvw::Loop::getDefault()->resource<uvw::IdleHandle>();
+    idle_->on<uvw::IdleEvent>([this](const uvw::IdleEvent&, uvw::IdleHandle&) { run_ready(); });
+  }
+  if (ready_.empty()) {
+    idle_->start(); // loop doesn't block in poll while idle handle is active
+  }
+  ready_.push_back(std::move(callback));
+}
+
+void Scheduler::run_ready() {
+  // callbacks posted meanwhile wait for next iteration, so loop isn't starved
+  running_.swap(ready_);
+  for (auto& callback : running_) {
+    callback();
+  }
+  running_.clear();
+
+  if (ready_.empty()) {
+    idle_->stop();
+  }
+}
+
+void Scheduler::add(Timer* timer, std::chrono::milliseconds delay) {
+  auto now = now_tick();
+  if (wheel_.size() == 0) {
+    TimerWheel::Node none{};
+    wheel_.advance(now, none); // catches up after idle time, so placement is precise
+  }
+  timer->expires = now + static_cast<uint64_t>(std::max(delay.count(), int64_t{ 0 }));
+  wheel_.insert(timer);
+  if (!wakeup_ || timer->expires < *wakeup_) {
+    update_wakeup();
+  }
+}
+
+void Scheduler::remove(Timer* timer) {
+  wheel_.remove(timer); // loop timer is left as is, spurious wakeup is cheaper than rearming
+
+  // but armed loop timer keeps run_main_loop() from returning after shutdown
+  if (wheel_.size() == 0 && timer_) {
+    timer_->stop();
+    wakeup_.reset();
+  }
+}
+
+void Scheduler::run_timers() {
+  wakeup_.reset();
+
+  TimerWheel::Node due{};
+  wheel_.advance(now_tick(), due);
+  while (due.linked()) {
+    auto timer = static_cast<Timer*>(due.next);
+    wheel_.remove(timer);
+    timer->callback_(); // could destroy timer or start it again
+  }
+
+  update_wakeup();
+}
+
+void Scheduler::update_wakeup() {
+  if (!timer_) {
+    timer_ = uvw::Loop::getDefault()->resource<uvw::TimerHandle>();
+    timer_->on<uvw::TimerEvent>([this](const uvw::TimerEvent&, uvw::TimerHandle&) { run_timers(); });
+  }
+
+  wakeup_ = wheel_.next_expiry();
+  if (!wakeup_) {
+    timer_->stop();
+    return;
+  }
+  auto now = now_tick();
+  timer_->start(uvw::TimerHandle::Time{ *wakeup_ > now ? *wakeup_ - now : 0 }, uvw::TimerHandle::Time{ 0 });
+}
+
+uint64_t Scheduler::now_tick() const {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_).count());
+}
+
+//---------------------------------------------------------------
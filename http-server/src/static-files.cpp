@@ -0,0 +1,516 @@
+#include "http-server/static-files.hpp"
+#include "http-server/log.hpp"
+#include "http-server/utils.hpp"
+
+#ifndef _WIN32
+  #include <unistd.h>
+#endif
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+namespace {
+  struct FsResult {
+    ssize_t   result; // negative libuv error code on failure
+    uv_stat_t stat;   // for stat requests
+  };
+
+  // awaits libuv fs request, which is started by start(loop, req, cb) on loop thread
+  template <typename TStart>
+  class FsAwaitable {
+    TStart                  start_;
+    uv_fs_t                 req_{};
+    std::coroutine_handle<> handle_{};
+
+  public:
+    explicit FsAwaitable(TStart start)
+        : start_{ std::move(start) } {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+      handle_   = handle;
+      req_.data = this;
+      int error = start_(uvw::Loop::getDefault()->raw(), &req_, [](uv_fs_t* req) {
+        static_cast<FsAwaitable*>(req->data)->handle_.resume();
+      });
+      if (error < 0) {
+        req_.result = error;
+        return false;
+      }
+      return true;
+    }
+
+    FsResult await_resume() {
+      FsResult result{ static_cast<ssize_t>(req_.result), req_.statbuf };
+      uv_fs_req_cleanup(&req_);
+      return result;
+    }
+  };
+
+  auto fs_open(const std::string& path) {
+    return FsAwaitable{ [&path](uv_loop_t* loop, uv_fs_t* req, uv_fs_cb cb) {
+      return uv_fs_open(loop, req, path.c_str(), UV_FS_O_RDONLY, 0, cb);
+    } };
+  }
+
+  auto fs_stat(const std::string& path) {
+    return FsAwaitable{ [&path](uv_loop_t* loop, uv_fs_t* req, uv_fs_cb cb) {
+      return uv_fs_stat(loop, req, path.c_str(), cb);
+    } };
+  }
+
+  auto fs_fstat(uv_file fd) {
+    return FsAwaitable{ [fd](uv_loop_t* loop, uv_fs_t* req, uv_fs_cb cb) {
+      return uv_fs_fstat(loop, req, fd, cb);
+    } };
+  }
+
+  uint64_t mtime_ns(const uv_stat_t& stat) {
+    return static_cast<uint64_t>(stat.st_mtim.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(stat.st_mtim.tv_nsec);
+  }
+
+  bool is_regular(const uv_stat_t& stat) {
+    return (stat.st_mode & S_IFMT) == S_IFREG;
+  }
+
+  bool same_file(const CachedFile& file, const uv_stat_t& stat) {
+    return is_regular(stat) && file.size == stat.st_size && file.mtime == mtime_ns(stat) && file.ino == stat.st_ino;
+  }
+
+  std::string_view mime_type(std::string_view path) {
+    static constexpr std::pair<std::string_view, std::string_view> types[]{
+      { "html", "text/html; charset=utf-8" },
+      { "htm", "text/html; charset=utf-8" },
+      { "css", "text/css; charset=utf-8" },
+      { "js", "application/javascript; charset=utf-8" },
+      { "mjs", "application/javascript; charset=utf-8" },
+      { "json", Mime::application_json },
+      { "txt", "text/plain; charset=utf-8" },
+      { "csv", Mime::text_csv },
+      { "xml", Mime::application_xml },
+      { "svg", Mime::image_svg_xml },
+      { "png", Mime::image_png },
+      { "jpg", Mime::image_jpeg },
+      { "jpeg", Mime::image_jpeg },
+      { "gif", Mime::image_gif },
+      { "webp", Mime::image_webp },
+      { "ico", Mime::image_x_icon },
+      { "woff", Mime::font_woff },
+      { "woff2", Mime::font_woff2 },
+      { "wasm", Mime::application_wasm },
+      { "pdf", Mime::application_pdf },
+      { "zip", Mime::application_zip },
+      { "mp3", Mime::audio_mpeg },
+      { "ogg", Mime::audio_ogg },
+      { "mp4", Mime::video_mp4 },
+      { "webm", Mime::video_webm },
+    };
+
+    auto name = path.substr(path.rfind('/') + 1);
+    auto dot  = name.rfind('.');
+    if (dot != std::string_view::npos) {
+      auto extension = name.substr(dot + 1);
+      for (auto& [type_extension, type] : types) {
+        if (iequals(extension, type_extension)) {
+          return type;
+        }
+      }
+    }
+    return Mime::application_octet_stream;
+  }
+
+  std::string make_etag(uint64_t size, uint64_t mtime) {
+    char result[40]{};
+    int  length = std::snprintf(result, sizeof(result), "\"%llx-%llx\"",
+                                static_cast<unsigned long long>(size), static_cast<unsigned long long>(mtime));
+    return { result, static_cast<size_t>(std::max(length, 0)) };
+  }
+
+  std::optional<std::string_view> find_header(const HttpRequest& request, std::string_view key) {
+    auto it = request.headers.find(key);
+    if (it == request.headers.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  struct ByteRange {
+    uint64_t first{ 0 };
+    uint64_t last{ 0 }; // inclusive
+    bool     satisfiable{ true };
+  };
+
+  // single range of "bytes=first-last", "bytes=first-" or "bytes=-suffix".
+  // nullopt if header should be ignored: malformed or multiple ranges
+  std::optional<ByteRange> parse_range(std::string_view header, uint64_t size) {
+    if (!header.starts_with("bytes=") || header.find(',') != std::string_view::npos) {
+      return std::nullopt;
+    }
+    header.remove_prefix(6);
+    auto dash = header.find('-');
+    if (dash == std::string_view::npos) {
+      return std::nullopt;
+    }
+
+    auto parse = [](std::string_view text, uint64_t& value) {
+      auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+      return !text.empty() && ec == std::errc{} && end == text.data() + text.size();
+    };
+
+    uint64_t first{ 0 };
+    uint64_t last{ 0 };
+    auto     first_text = header.substr(0, dash);
+    auto     last_text  = header.substr(dash + 1);
+
+    if (first_text.empty()) {
+      if (!parse(last_text, last)) {
+        return std::nullopt;
+      }
+      if (last == 0 || size == 0) {
+        return ByteRange{ .satisfiable = false };
+      }
+      return ByteRange{ .first = size - std::min(last, size), .last = size - 1 };
+    }
+
+    if (!parse(first_text, first) || (!last_text.empty() && (!parse(last_text, last) || last < first))) {
+      return std::nullopt;
+    }
+    if (first >= size) {
+      return ByteRange{ .satisfiable = false };
+    }
+    return ByteRange{ .first = first, .last = last_text.empty() ? size - 1 : std::min(last, size - 1) };
+  }
+
+  //---------------------------------------------------------------
+  // writes file range to connection socket with uv_fs_sendfile on thread pool.
+  // socket descriptor is duplicated, so it can't be reused by other connection
+  // while sendfile is running. socket is non blocking: when its buffer is full,
+  // sending is resumed by poll handle on writable event.
+  // falls back to uv_fs_read and regular writes if descriptor is not available (windows).
+  class FileSender : public HttpResponseSender, public std::enable_shared_from_this<FileSender> {
+    static constexpr size_t read_chunk_size{ 64 * 1024 };
+
+    std::shared_ptr<CachedFile>         file_;
+    uint64_t                            offset_;
+    uint64_t                            remaining_;
+    uint64_t                            length_;
+    std::unique_ptr<HttpResponseWriter> writer_{};
+    std::shared_ptr<FileSender>         self_{}; // keeps sender alive while request is running
+    std::shared_ptr<uvw::PollHandle>    poll_{};
+    int                                 socket_{ -1 };
+    uv_fs_t                             req_{};
+    std::string                         buffer_{};
+
+  public:
+    FileSender(std::shared_ptr<CachedFile> file, uint64_t offset, uint64_t length)
+        : file_{ std::move(file) }
+        , offset_{ offset }
+        , remaining_{ length }
+        , length_{ length } {}
+
+    ~FileSender() override { close_socket(); }
+
+    [[nodiscard]] size_t length() const override { return static_cast<size_t>(length_); }
+
+    void start(std::unique_ptr<HttpResponseWriter> writer) override {
+      writer_ = std::move(writer);
+      self_   = shared_from_this();
+      if (remaining_ == 0) {
+        finish(true);
+        return;
+      }
+
+#ifndef _WIN32
+      if (auto fd = writer_->fd(); fd >= 0) {
+        socket_ = ::dup(fd);
+      }
+#endif
+
+      // poll isn't woken up when connection is closed by write timeout, descriptor is still open
+      writer_->on_close([this] {
+        if (poll_ && poll_->active()) {
+          poll_->stop();
+          finish(false);
+        }
+      });
+      writer_->outstanding(static_cast<size_t>(remaining_));
+
+      // headers are queued by uv_write, body goes to socket directly, so it waits for them
+      writer_->on_drain([this] { send_next(); });
+    }
+
+  private:
+    void send_next() {
+      if (writer_->closed()) {
+        finish(false);
+        return;
+      }
+      if (remaining_ == 0) {
+        finish(true);
+        return;
+      }
+
+      auto loop = uvw::Loop::getDefault()->raw();
+      req_.data = this;
+      int error{ 0 };
+      if (socket_ >= 0) {
+        error = uv_fs_sendfile(loop, &req_, socket_, file_->fd, static_cast<int64_t>(offset_), static_cast<size_t>(remaining_),
+                               [](uv_fs_t* req) { static_cast<FileSender*>(req->data)->on_sent(); });
+      } else {
+        buffer_.resize(static_cast<size_t>(std::min<uint64_t>(remaining_, read_chunk_size)));
+        auto buf = uv_buf_init(buffer_.data(), static_cast<unsigned int>(buffer_.size()));
+        error    = uv_fs_read(loop, &req_, file_->fd, &buf, 1, static_cast<int64_t>(offset_),
+                              [](uv_fs_t* req) { static_cast<FileSender*>(req->data)->on_read(); });
+      }
+      if (error < 0) {
+        g_log->error("file sender: {}", uv_strerror(error));
+        finish(false);
+      }
+    }
+
+    void on_sent() {
+      auto result = req_.result;
+      uv_fs_req_cleanup(&req_);
+
+      if (result == UV_EAGAIN) {
+        wait_writable();
+        return;
+      }
+      if (result <= 0) { // error, or file was truncated
+        g_log->debug("file sender: sendfile failed: {}", result < 0 ? uv_strerror(static_cast<int>(result)) : "end of file");
+        finish(false);
+        return;
+      }
+      advance(static_cast<uint64_t>(result));
+      send_next();
+    }
+
+    void on_read() {
+      auto result = req_.result;
+      uv_fs_req_cleanup(&req_);
+
+      if (result <= 0) {
+        g_log->debug("file sender: read failed: {}", result < 0 ? uv_strerror(static_cast<int>(result)) : "end of file");
+        finish(false);
+        return;
+      }
+      writer_->data.write(buffer_.data(), result);
+      writer_->flush();
+      advance(static_cast<uint64_t>(result));
+      writer_->on_drain([this] { send_next(); });
+    }
+
+    void wait_writable() {
+      if (writer_->closed()) {
+        finish(false);
+        return;
+      }
+      if (!poll_) {
+        poll_ = uvw::Loop::getDefault()->resource<uvw::PollHandle>(socket_);
+        if (!poll_) {
+          g_log->error("file sender: can't poll socket");
+          finish(false);
+          return;
+        }
+        poll_->on<uvw::PollEvent>([this](const uvw::PollEvent&, uvw::PollHandle& poll) {
+          poll.stop();
+          send_next();
+        });
+        poll_->on<uvw::ErrorEvent>([this](const uvw::ErrorEvent& err, uvw::PollHandle& poll) {
+          g_log->debug("file sender: poll error: {}", err.what());
+          poll.stop();
+          finish(false);
+        });
+      }
+      poll_->start(uvw::PollHandle::Event::WRITABLE);
+    }
+
+    void advance(uint64_t sent) {
+      offset_ += sent;
+      remaining_ -= std::min(sent, remaining_);
+      writer_->outstanding(static_cast<size_t>(remaining_));
+    }
+
+    void finish(bool complete) {
+      if (!complete) {
+        writer_->keep_alive = false; // client can't tell where truncated body ends
+      }
+      writer_->done();
+      writer_.reset();
+      close_socket();
+      file_.reset();
+      self_.reset(); // could be last reference
+    }
+
+    void close_socket() {
+      if (socket_ < 0) {
+        return;
+      }
+#ifndef _WIN32
+      if (poll_) {
+        // descriptor is closed after poll handle, as libuv requires
+        poll_->clear();
+        poll_->once<uvw::CloseEvent>([socket = socket_](const uvw::CloseEvent&, uvw::PollHandle&) { ::close(socket); });
+        poll_->close();
+        poll_.reset();
+      } else {
+        ::close(socket_);
+      }
+#endif
+      socket_ = -1;
+    }
+  };
+} // namespace
+
+//---------------------------------------------------------------
+
+CachedFile::~CachedFile() {
+  if (fd >= 0) {
+    uv_fs_t req{};
+    uv_fs_close(uvw::Loop::getDefault()->raw(), &req, fd, nullptr); // synchronous without callback
+    uv_fs_req_cleanup(&req);
+  }
+}
+
+//---------------------------------------------------------------
+
+Task<std::shared_ptr<CachedFile>> FileCache::open(std::string path) {
+  auto now = std::chrono::steady_clock::now();
+  if (auto file = find(path)) {
+    if (now - file->checked_at < settings_.revalidate) {
+      co_return file;
+    }
+    auto stat = co_await fs_stat(path);
+    if (stat.result == 0 && same_file(*file, stat.stat)) {
+      file->checked_at = now;
+      co_return file;
+    }
+    erase(path); // file is changed, in-flight responses keep sending old descriptor
+  }
+
+  auto opened = co_await fs_open(path);
+  if (opened.result < 0) {
+    co_return nullptr;
+  }
+  auto file = std::make_shared<CachedFile>();
+  file->fd  = static_cast<uv_file>(opened.result);
+
+  auto stat = co_await fs_fstat(file->fd);
+  if (stat.result < 0 || !is_regular(stat.stat)) {
+    co_return nullptr; // directory or special file, descriptor is closed by CachedFile
+  }
+
+  file->size          = stat.stat.st_size;
+  file->mtime         = mtime_ns(stat.stat);
+  file->ino           = stat.stat.st_ino;
+  file->etag          = make_etag(file->size, file->mtime);
+  file->last_modified = http_date(static_cast<std::time_t>(stat.stat.st_mtim.tv_sec));
+  file->content_type  = mime_type(path);
+  file->checked_at    = now;
+
+  insert(path, file);
+  co_return file;
+}
+
+std::shared_ptr<CachedFile> FileCache::find(const std::string& path) {
+  auto it = entries_.find(path);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru);
+  return it->second.file;
+}
+
+void FileCache::insert(const std::string& path, std::shared_ptr<CachedFile> file) {
+  erase(path); // could be opened concurrently by other request
+  lru_.push_front(path);
+  entries_.emplace(path, Entry{ std::move(file), lru_.begin() });
+  while (entries_.size() > settings_.max_open_files) {
+    erase(lru_.back());
+  }
+}
+
+void FileCache::erase(const std::string& path) {
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+  }
+}
+
+//---------------------------------------------------------------
+
+Task<HttpResponse> StaticFiles::serve(const HttpRequest& request, std::string_view path) {
+  HttpResponse response{};
+
+  // path is checked after decoding, so encoded dots and slashes can't escape root
+  auto relative = url_decode(path);
+  bool valid    = relative && relative->find_first_of(std::string_view{ "\\\0", 2 }) == std::string::npos;
+  for (std::string_view rest = valid ? *relative : ""; valid && !rest.empty();) {
+    auto segment = rest.substr(0, rest.find('/'));
+    rest.remove_prefix(std::min(segment.size() + 1, rest.size()));
+    valid = segment != "." && segment != ".." && (!segment.empty() || rest.empty());
+  }
+  if (!valid) {
+    g_log->debug("static files: invalid path '{}'", path);
+    response.status(HttpStatusCode::NotFound).with_default_status_message();
+    co_return response;
+  }
+  if (relative->empty() || relative->ends_with('/')) {
+    *relative += settings_.index;
+  }
+
+  auto file = co_await cache_.open(settings_.root + "/" + *relative);
+  if (!file) {
+    response.status(HttpStatusCode::NotFound).with_default_status_message();
+    co_return response;
+  }
+
+  response.header(HttpResponseHeaderKey::ETag, file->etag)
+      .header(HttpResponseHeaderKey::LastModified, file->last_modified);
+  if (!settings_.cache_control.empty()) {
+    response.header(HttpResponseHeaderKey::CacheControl, settings_.cache_control);
+  }
+
+  // If-Modified-Since is compared as is: clients send back Last-Modified value
+  auto if_none_match = find_header(request, HttpRequestHeaderKey::IfNoneMatch);
+  auto not_modified  = if_none_match ? etag_matches(*if_none_match, file->etag)
+                                     : find_header(request, HttpRequestHeaderKey::IfModifiedSince) == file->last_modified;
+  if (not_modified) {
+    response.status(HttpStatusCode::NotModified);
+    co_return response;
+  }
+
+  // If-Range with other validator means file has changed, whole file is sent then
+  auto range_header = find_header(request, HttpRequestHeaderKey::Range);
+  auto if_range     = find_header(request, HttpRequestHeaderKey::IfRange);
+  auto range        = range_header && (!if_range || *if_range == file->etag || *if_range == file->last_modified)
+                          ? parse_range(*range_header, file->size)
+                          : std::nullopt;
+
+  if (range && !range->satisfiable) {
+    response.status(HttpStatusCode::RequestedRangeNotSatisfiable)
+        .header(HttpResponseHeaderKey::ContentRange, "bytes */" + std::to_string(file->size))
+        .with_default_status_message();
+    co_return response;
+  }
+
+  // file type is set for file body only, 416 is answered with text status message
+  response.header(HttpResponseHeaderKey::ContentType, file->content_type)
+      .header(HttpResponseHeaderKey::AcceptRanges, "bytes");
+
+  if (range) {
+    auto content_range = "bytes " + std::to_string(range->first) + "-" + std::to_string(range->last) + "/" + std::to_string(file->size);
+    response.status(HttpStatusCode::PartialContent)
+        .header(HttpResponseHeaderKey::ContentRange, content_range)
+        .send(std::make_shared<FileSender>(file, range->first, range->last - range->first + 1));
+    co_return response;
+  }
+
+  response.status(HttpStatusCode::OK).send(std::make_shared<FileSender>(file, 0, file->size));
+  co_return response;
+}
+
+//---------------------------------------------------------------
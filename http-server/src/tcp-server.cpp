@@ -1,30 +1,373 @@
 #include "http-server/tcp-server.hpp"
 #include "http-server/log.hpp"
+#include "http-server/scheduler.hpp"
+
+#ifndef _WIN32
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+#endif
 
 using namespace http;
 
 //---------------------------------------------------------------
 
-struct TcpWriter : public ITcpWriter {
-  std::shared_ptr<uvw::TCPHandle> handle;
-  std::string                     data_result;
+#ifdef __linux__
+static int bind_abstract_socket(const std::string& name) {
+  sockaddr_un addr{};
+  if (name.size() + 1 > sizeof(addr.sun_path)) {
+    g_log->error("unix socket name is too long: @{}", name);
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path + 1, name.data(), name.size()); // leading zero byte selects abstract namespace
 
-  explicit TcpWriter(std::shared_ptr<uvw::TCPHandle> handle)
-      : handle{ std::move(handle) } {}
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd < 0) {
+    g_log->error("unix socket error: {}", std::strerror(errno));
+    return -1;
+  }
+  auto length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), length) != 0) {
+    g_log->error("unix socket bind error on @{}: {}", name, std::strerror(errno));
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+#endif
 
-  ~TcpWriter() override { g_log->debug("~TcpWriter"); }
+//---------------------------------------------------------------
+// per loop pool of read buffers, replaces uvw's new[] per read. libuv takes buffer right
+// before reading and it's returned after read callback, readers copy what they keep,
+// so usually one block is in use at a time.
+class ReadBuffers {
+  static constexpr size_t block_size{ 64 * 1024 }; // libuv suggests this size
+  static constexpr size_t max_free{ 8 };
 
-  void done() override {
-    data_result = data.str();
+  std::vector<std::unique_ptr<char[]>> free_{};
 
-    g_log->debug("tcp_writer: write {} bytes", data_result.size());
-    handle->write(const_cast<char*>(data_result.c_str()),
-                  static_cast<unsigned int>(data_result.size()));
+public:
+  static ReadBuffers& local() {
+    static thread_local ReadBuffers buffers;
+    return buffers;
+  }
+
+  static void alloc(uv_handle_t*, size_t, uv_buf_t* buf) {
+    *buf = uv_buf_init(local().acquire().release(), static_cast<unsigned int>(block_size));
+  }
+
+  std::unique_ptr<char[]> acquire() {
+    if (free_.empty()) {
+      return std::make_unique_for_overwrite<char[]>(block_size);
+    }
+    auto block = std::move(free_.back());
+    free_.pop_back();
+    return block;
+  }
+
+  void release(char* block) {
+    if (block && free_.size() < max_free) {
+      free_.emplace_back(block);
+    } else {
+      delete[] block;
+    }
+  }
+};
+
+// callbacks of connection, kept in user data of client handle for libuv callbacks
+struct StreamContext {
+  ITcpReader*           reader{ nullptr };
+  std::function<void()> on_written{}; // write request is completed
+};
 
-    // todo: handle->on< ... written >([handle](){ handle->close() });
+template <typename THandle>
+static void on_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  auto& handle = *static_cast<THandle*>(stream->data); // set by uvw
+  if (nread > 0) {
+    g_log->debug("client_handle: data event");
+    handle.template data<StreamContext>()->reader->read(buf->base, static_cast<size_t>(nread));
+  } else if (nread < 0) {
+    if (nread == UV_EOF) {
+      g_log->debug("client_handle: end event");
+    } else {
+      g_log->debug("client_handle: read error: {}", uv_strerror(static_cast<int>(nread)));
+    }
+    if (!handle.closing()) {
+      handle.close();
+    }
+  }
+  ReadBuffers::local().release(buf->base);
+}
+
+//---------------------------------------------------------------
+
+// one vectored write, segments are owned until libuv is done with them
+struct WriteRequest {
+  uv_write_t               req{};
+  std::vector<std::string> segments{};
+};
+
+template <typename THandle>
+static void on_written(uv_write_t* req, int status) {
+  std::unique_ptr<WriteRequest> request{ static_cast<WriteRequest*>(req->data) };
+  auto&                         handle = *static_cast<THandle*>(req->handle->data);
+  if (status != 0) {
+    g_log->debug("client_handle: write error: {}", uv_strerror(status)); // also cancelled ones on close
+    if (!handle.closing()) {
+      handle.close();
+    }
+    return;
+  }
+  if (auto context = handle.template data<StreamContext>(); context->on_written) {
+    context->on_written();
+  }
+}
+
+// writer which has data collected during current loop iteration
+struct BatchedWriter : public ITcpWriter {
+  bool queued{ false };
+
+  virtual void send() = 0;
+};
+
+// per loop list of writers to send, they are sent together on next loop iteration,
+// so everything written meanwhile (e.g. pipelined responses) goes out in one write per connection.
+class WriteBatch {
+  std::vector<BatchedWriter*> queued_{};
+
+public:
+  static WriteBatch& local() {
+    static thread_local WriteBatch batch;
+    return batch;
+  }
+
+  void add(BatchedWriter* writer) {
+    if (writer->queued) {
+      return;
+    }
+    if (queued_.empty()) {
+      Scheduler::local().post([this] { run(); });
+    }
+    writer->queued = true;
+    queued_.push_back(writer);
+  }
+
+  void remove(BatchedWriter* writer) {
+    if (writer->queued) {
+      writer->queued = false;
+      std::erase(queued_, writer);
+    }
+  }
+
+private:
+  void run() {
+    auto writers = std::move(queued_);
+    queued_.clear();
+    for (auto writer : writers) {
+      writer->queued = false;
+      writer->send();
+    }
+  }
+};
+
+//---------------------------------------------------------------
+
+// writes to accepted connection, tcp or unix socket
+template <typename THandle>
+struct StreamWriter : public BatchedWriter {
+  std::shared_ptr<THandle> handle;
+  std::function<void()>    drain_callback;
+  bool                     is_done{ false };
+  std::vector<std::string> segments{};        // not sent yet
+  size_t                   segments_size{ 0 }; // bytes in segments
+  bool                     corked{ false };
+  bool                     uncork{ false }; // after segments are sent
+
+  explicit StreamWriter(std::shared_ptr<THandle> handle)
+      : handle{ std::move(handle) } {
+    context().on_written = [this] {
+      if (pending() == 0 && drain_callback) {
+        auto callback  = std::move(drain_callback);
+        drain_callback = nullptr;
+        callback();
+      }
+    };
+  }
+
+  ~StreamWriter() override {
+    g_log->debug("~StreamWriter");
+    WriteBatch::local().remove(this);
+    if (!is_done) {
+      context().on_written = nullptr;
+    }
+  }
+
+  void done() override {
+    write_data();
+    WriteBatch::local().remove(this);
+    send(); // connection is closing, nothing to batch with
+    is_done = true;
+
+    // writer is deleted right after done(), so closing is bound to the handle only
+    if (handle->writeQueueSize() == 0) {
+      context().on_written = nullptr;
+      if (!handle->closing()) {
+        handle->close();
+      }
+    } else {
+      context().on_written = [handle = handle.get()] {
+        if (handle->writeQueueSize() == 0 && !handle->closing()) {
+          handle->close();
+        }
+      };
+    }
 
     g_log->debug("tcp_writer: done");
-    handle->close();
+  }
+
+  void flush() override {
+    write_data();
+    if (!segments.empty()) {
+      WriteBatch::local().add(this);
+    }
+  }
+
+  size_t pending() const override { return handle->writeQueueSize() + segments_size; }
+  bool   closed() const override { return handle->closing(); }
+
+  int fd() const override {
+#ifdef _WIN32
+    return -1;
+#else
+    return handle->closing() ? -1 : static_cast<int>(handle->fd());
+#endif
+  }
+
+  std::string peer() const override {
+    if constexpr (std::is_same_v<THandle, uvw::TCPHandle>) {
+      sockaddr_storage addr{};
+      int              length = sizeof(addr);
+      if (handle->closing() || uv_tcp_getpeername(handle->raw(), reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+        return {};
+      }
+
+      // uvw's peer() needs address family up front, listener could accept both
+      char ip[64]{};
+      if (addr.ss_family == AF_INET6) {
+        uv_ip6_name(reinterpret_cast<const sockaddr_in6*>(&addr), ip, sizeof(ip));
+      } else {
+        uv_ip4_name(reinterpret_cast<const sockaddr_in*>(&addr), ip, sizeof(ip));
+      }
+      return ip;
+    } else {
+      return {}; // unix socket peers have no address
+    }
+  }
+
+  void abort() override {
+    segments.clear();
+    segments_size = 0;
+    if (!handle->closing()) {
+      handle->close();
+    }
+  }
+
+  void cork(bool enable) override {
+    if (!enable && !segments.empty()) {
+      uncork = true; // queued data should go out in full packets too
+      return;
+    }
+    uncork = false;
+    set_cork(enable);
+  }
+
+  void on_drain(std::function<void()> cb) override {
+    if (pending() == 0 || closed()) {
+      cb();
+    } else {
+      drain_callback = std::move(cb);
+    }
+  }
+
+  // pending writes are cancelled, so waiter of drain is woken up to see closed()
+  void on_close() {
+    if (drain_callback) {
+      auto callback  = std::move(drain_callback);
+      drain_callback = nullptr;
+      callback();
+    }
+  }
+
+  // segments collected so far are written at once
+  void send() override {
+    if (segments.empty() || handle->closing()) {
+      segments.clear();
+      segments_size = 0;
+      return;
+    }
+
+    auto request      = std::make_unique<WriteRequest>();
+    request->segments = std::move(segments);
+    request->req.data = request.get();
+    segments.clear();
+    segments_size = 0;
+
+    std::vector<uv_buf_t> buffers{};
+    buffers.reserve(request->segments.size());
+    for (auto& segment : request->segments) {
+      buffers.push_back(uv_buf_init(segment.data(), static_cast<unsigned int>(segment.size())));
+    }
+
+    g_log->debug("tcp_writer: write {} segments", buffers.size());
+    auto stream = reinterpret_cast<uv_stream_t*>(handle->raw());
+    if (auto err = uv_write(&request->req, stream, buffers.data(), static_cast<unsigned int>(buffers.size()), &on_written<THandle>); err != 0) {
+      g_log->debug("tcp_writer: write error: {}", uv_strerror(err));
+      handle->close();
+      return;
+    }
+    request.release(); // freed in on_written
+
+    if (uncork) {
+      uncork = false;
+      set_cork(false);
+    }
+  }
+
+private:
+  StreamContext& context() { return *handle->template data<StreamContext>(); }
+
+  void write_data() {
+    auto str = std::move(data).str(); // stream buffer is taken without copying
+    data.str({});
+    if (str.empty() || handle->closing()) {
+      return;
+    }
+    segments_size += str.size();
+    segments.push_back(std::move(str));
+  }
+
+  void set_cork(bool enable) {
+    if (corked == enable || handle->closing()) {
+      return;
+    }
+    corked = enable;
+#if defined(TCP_CORK) || defined(TCP_NOPUSH)
+    if constexpr (std::is_same_v<THandle, uvw::TCPHandle>) {
+  #ifdef TCP_CORK
+      int option = TCP_CORK;
+  #else
+      int option = TCP_NOPUSH;
+  #endif
+      int value = enable ? 1 : 0;
+      if (::setsockopt(fd(), IPPROTO_TCP, option, &value, sizeof(value)) != 0) {
+        g_log->debug("tcp_writer: cork error: {}", std::strerror(errno));
+      }
+    }
+#endif
   }
 };
 
@@ -58,34 +401,62 @@ struct TcpWriterClient : public ITcpWriter {
 TcpServer::TcpServer(std::unique_ptr<ITcpReaderFactory> client_factory)
     : handle_{ uvw::Loop::getDefault()->resource<uvw::TCPHandle>() }
     , reader_factory_{ std::move(client_factory) } {
+  setup_listener(handle_);
+}
 
-  handle_->on<uvw::ErrorEvent>([](const uvw::ErrorEvent& err, uvw::TCPHandle&) {
+template <typename THandle>
+void TcpServer::setup_listener(const std::shared_ptr<THandle>& listener) {
+  listener->template on<uvw::ErrorEvent>([](const uvw::ErrorEvent& err, THandle&) {
     g_log->error("tcp_ handle error: {}", err.what()); // TODO: handle it properly (close handle ...)
   });
 
-  handle_->on<uvw::ListenEvent>([this](const uvw::ListenEvent&, uvw::TCPHandle& handle) {
-    auto client_handle = handle.loop().resource<uvw::TCPHandle>();
-    auto reader        = reader_factory_->create(new TcpWriter(client_handle));
-
-    client_handle->on<uvw::CloseEvent>([this, reader](const uvw::CloseEvent&, uvw::TCPHandle& handle) {
-      g_log->debug("client_handle: close event");
-      reader_factory_->destroy(reader);
-    });
+  listener->template on<uvw::ListenEvent>([this](const uvw::ListenEvent&, THandle& handle) {
+    // libuv stops polling listener until pending connection is accepted
+    if (max_connections_ != 0 && connections_ >= max_connections_) {
+      g_log->debug("client_handle: connection limit {} reached, accept paused", max_connections_);
+      paused_.push_back([this, listener = handle.shared_from_this()] {
+        if (!listener->closing()) {
+          accept(*listener);
+        }
+      });
+      return;
+    }
+    accept(handle);
+  });
+}
 
-    client_handle->on<uvw::EndEvent>([](const uvw::EndEvent&, uvw::TCPHandle& client) {
-      g_log->debug("client_handle: end event");
-      client.close();
-    });
+template <typename THandle>
+void TcpServer::accept(THandle& handle) {
+  auto client_handle = handle.loop().template resource<THandle>();
+  auto context       = std::make_shared<StreamContext>();
+  client_handle->data(context);
+  auto writer     = new StreamWriter<THandle>(client_handle);
+  auto reader     = reader_factory_->create(writer);
+  context->reader = reader;
+  connections_++;
 
-    client_handle->on<uvw::DataEvent>([reader](const uvw::DataEvent& data, uvw::TCPHandle& handle) {
-      g_log->debug("client_handle: data event");
-      reader->read(data.data.get(), data.length);
-    });
+  // writer is owned by reader, so it's alive until reader is destroyed
+  client_handle->template on<uvw::CloseEvent>([this, reader, writer](const uvw::CloseEvent&, THandle&) {
+    g_log->debug("client_handle: close event");
+    writer->on_close();
+    reader_factory_->destroy(reader);
 
-    g_log->debug("client_handle: accept");
-    handle.accept(*client_handle);
-    client_handle->read();
+    connections_--;
+    if (!paused_.empty()) {
+      auto resume = std::move(paused_.back());
+      paused_.pop_back();
+      resume();
+    }
   });
+
+  g_log->debug("client_handle: accept");
+  handle.accept(*client_handle);
+  if constexpr (std::is_same_v<THandle, uvw::TCPHandle>) {
+    client_handle->noDelay(no_delay_);
+  }
+
+  // read is started directly, so buffers come from pool instead of uvw's allocation per read
+  uv_read_start(reinterpret_cast<uv_stream_t*>(client_handle->raw()), &ReadBuffers::alloc, &on_read<THandle>);
 }
 
 void TcpServer::listen(const char* addr, int port) {
@@ -93,4 +464,85 @@ void TcpServer::listen(const char* addr, int port) {
   handle_->listen();
 }
 
+void TcpServer::listen(int fd) {
+  handle_->open(fd);
+  handle_->listen();
+}
+
+int TcpServer::fd() const {
+#ifdef _WIN32
+  return -1;
+#else
+  uv_os_fd_t fd{ -1 };
+  if (handle_->closing() || uv_fileno(reinterpret_cast<uv_handle_t*>(handle_->raw()), &fd) != 0) {
+    return -1; // not bound yet
+  }
+  return fd;
+#endif
+}
+
+void TcpServer::listen_unix(const std::string& path) {
+  pipe_ = uvw::Loop::getDefault()->resource<uvw::PipeHandle>();
+  setup_listener(pipe_);
+
+#ifdef __linux__
+  if (!path.empty() && path.front() == '@') {
+    // libuv binds only to paths, so socket is bound here and passed to it
+    int fd = bind_abstract_socket(path.substr(1));
+    if (fd < 0) {
+      return;
+    }
+    pipe_->open(fd);
+    pipe_->listen();
+    return;
+  }
+#endif
+
+  remove_stale_unix_socket(path);
+  pipe_->bind(path);
+  pipe_->listen();
+}
+
+void TcpServer::close() {
+  if (!handle_->closing()) {
+    handle_->close();
+  }
+  if (pipe_ && !pipe_->closing()) {
+    pipe_->close();
+  }
+}
+
+//---------------------------------------------------------------
+
+void http::remove_stale_unix_socket(const std::string& path) {
+#ifndef _WIN32
+  struct stat info{};
+  if (::lstat(path.c_str(), &info) != 0 || !S_ISSOCK(info.st_mode)) {
+    return;
+  }
+
+  sockaddr_un addr{};
+  if (path.size() + 1 > sizeof(addr.sun_path)) {
+    return;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.data(), path.size());
+
+  // socket of running server accepts connection, socket left by previous run refuses it
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return;
+  }
+  bool stale = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 && errno == ECONNREFUSED;
+  ::close(fd);
+
+  if (stale) {
+    g_log->debug("removing stale unix socket {}", path);
+    ::unlink(path.c_str());
+  } else {
+    g_log->warn("unix socket {} is in use by other process", path);
+  }
+#endif
+}
+
 //---------------------------------------------------------------
@@ -0,0 +1,142 @@
+#include "http-server/timer-wheel.hpp"
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+void TimerWheel::Node::link_before(Node* node) {
+  prev       = node->prev;
+  next       = node;
+  prev->next = this;
+  node->prev = this;
+}
+
+void TimerWheel::Node::unlink() {
+  prev->next = next;
+  next->prev = prev;
+  prev = next = this;
+}
+
+//---------------------------------------------------------------
+
+void TimerWheel::insert(Node* node) {
+  place(node, now_ + 1);
+}
+
+void TimerWheel::place(Node* node, uint64_t earliest) {
+  // slot is chosen by highest bits where expiration differs from now,
+  // so timer reaches level 0 exactly when its 64 ticks block begins
+  auto   at    = std::min(std::max(node->expires, earliest), now_ + max_span);
+  auto   diff  = at ^ now_;
+  size_t level = 0;
+  while (level + 1 < levels_count && (diff >> (slot_bits * (level + 1))) != 0) {
+    level++;
+  }
+  link(node, static_cast<uint8_t>(level), static_cast<uint8_t>((at >> (slot_bits * level)) & (slots_count - 1)));
+}
+
+void TimerWheel::remove(Node* node) {
+  if (!node->linked()) {
+    return;
+  }
+  if (node->level != not_in_wheel) {
+    auto& slot = slots_[node->level][node->slot];
+    node->unlink();
+    if (!slot.linked()) {
+      occupied_[node->level] &= ~(uint64_t{ 1 } << node->slot);
+    }
+    count_--;
+  } else {
+    node->unlink();
+  }
+  node->level = not_in_wheel;
+}
+
+void TimerWheel::advance(uint64_t now, Node& due) {
+  // jumps from one occupied slot to another, ticks without timers are skipped
+  for (auto next = next_expiry(); next && *next <= now; next = next_expiry()) {
+    now_ = *next;
+    cascade();
+
+    Node expired{};
+    detach(0, static_cast<uint8_t>(now_ & (slots_count - 1)), expired);
+    while (expired.linked()) {
+      auto node = expired.next;
+      node->unlink();
+      if (node->expires > now_) {
+        insert(node); // parked far timer
+      } else {
+        node->level = not_in_wheel;
+        node->link_before(&due);
+      }
+    }
+  }
+  now_ = std::max(now_, now);
+}
+
+std::optional<uint64_t> TimerWheel::next_expiry() const {
+  if (count_ == 0) {
+    return std::nullopt;
+  }
+
+  auto result = std::numeric_limits<uint64_t>::max();
+  for (size_t level = 0; level < levels_count; level++) {
+    if (occupied_[level] == 0) {
+      continue;
+    }
+    // in units of level slots: occupied slot after current one, else first one in next turn
+    auto shift = slot_bits * level;
+    auto units = now_ >> shift;
+    auto index = units & (slots_count - 1);
+    auto turn  = units - index;
+    auto later = index + 1 < slots_count ? occupied_[level] & (~uint64_t{ 0 } << (index + 1)) : 0;
+    auto slot  = later ? turn + static_cast<uint64_t>(std::countr_zero(later))
+                       : turn + slots_count + static_cast<uint64_t>(std::countr_zero(occupied_[level]));
+    result = std::min(result, slot << shift);
+  }
+  return result;
+}
+
+void TimerWheel::link(Node* node, uint8_t level, uint8_t slot) {
+  node->level = level;
+  node->slot  = slot;
+  node->link_before(&slots_[level][slot]);
+  occupied_[level] |= uint64_t{ 1 } << slot;
+  count_++;
+}
+
+void TimerWheel::detach(uint8_t level, uint8_t slot, Node& list) {
+  auto& head = slots_[level][slot];
+  if (!head.linked()) {
+    return;
+  }
+  list.next       = head.next;
+  list.prev       = head.prev;
+  list.next->prev = &list;
+  list.prev->next = &list;
+  head.next = head.prev = &head;
+
+  occupied_[level] &= ~(uint64_t{ 1 } << slot);
+  for (auto node = list.next; node != &list; node = node->next) {
+    count_--;
+  }
+}
+
+void TimerWheel::cascade() {
+  // from top, so timers could cascade down through several levels at once
+  for (size_t level = levels_count - 1; level > 0; level--) {
+    auto shift = slot_bits * level;
+    if ((now_ & ((uint64_t{ 1 } << shift) - 1)) != 0) {
+      continue;
+    }
+    Node moved{};
+    detach(static_cast<uint8_t>(level), static_cast<uint8_t>((now_ >> shift) & (slots_count - 1)), moved);
+    while (moved.linked()) {
+      auto node = moved.next;
+      node->unlink();
+      place(node, now_); // could be due right now
+    }
+  }
+}
+
+//---------------------------------------------------------------
@@ -0,0 +1,966 @@
+#include "http-server/uring-server.hpp"
+#include "http-server/log.hpp"
+
+#ifdef HTTP_SERVER_IO_URING
+
+  #include <arpa/inet.h>
+  #include <linux/io_uring.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <sys/mman.h>
+  #include <sys/socket.h>
+  #include <sys/syscall.h>
+  #include <sys/uio.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+
+using namespace http;
+
+//---------------------------------------------------------------
+
+// kind of request is kept in low bits of user data, rest is pointer to listener or connection
+enum class Operation : uint64_t {
+  Accept = 1,
+  Recv   = 2,
+  Send   = 3,
+  Close  = 4,
+  Cancel = 5, // result is not needed
+};
+
+static constexpr uint64_t operation_mask{ 7 };
+static constexpr size_t   max_iov{ 1024 }; // segments per sendmsg
+
+static uint64_t make_user_data(void* target, Operation operation) {
+  return reinterpret_cast<uint64_t>(target) | static_cast<uint64_t>(operation);
+}
+
+//---------------------------------------------------------------
+// submission and completion queues mapped from kernel, without liburing.
+// requests are queued locally and published to kernel by submit().
+class http::UringRing {
+  int           fd_{ -1 };
+  unsigned      sq_entries_{ 0 };
+  void*         rings_{ MAP_FAILED };
+  size_t        rings_size_{ 0 };
+  io_uring_sqe* sqes_{ nullptr };
+  size_t        sqes_size_{ 0 };
+  unsigned*     sq_head_{ nullptr };
+  unsigned*     sq_tail_{ nullptr };
+  unsigned*     sq_mask_{ nullptr };
+  unsigned*     sq_flags_{ nullptr };
+  unsigned*     cq_head_{ nullptr };
+  unsigned*     cq_tail_{ nullptr };
+  unsigned*     cq_mask_{ nullptr };
+  io_uring_cqe* cqes_{ nullptr };
+  unsigned      sqe_tail_{ 0 }; // queued locally, not published yet
+
+public:
+  UringRing() = default;
+
+  UringRing(const UringRing&)            = delete;
+  UringRing& operator=(const UringRing&) = delete;
+
+  ~UringRing() {
+    if (sqes_) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (rings_ != MAP_FAILED) {
+      ::munmap(rings_, rings_size_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  [[nodiscard]] int fd() const { return fd_; }
+
+  bool init(unsigned entries) {
+    io_uring_params params{};
+    params.flags      = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4; // multishot requests produce many completions
+
+    fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      g_log->error("io_uring: setup error: {}", std::strerror(errno));
+      return false;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+      g_log->error("io_uring: kernel is too old");
+      return false;
+    }
+
+    sq_entries_ = params.sq_entries;
+    rings_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                           params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    rings_      = ::mmap(nullptr, rings_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (rings_ == MAP_FAILED) {
+      g_log->error("io_uring: can't map rings: {}", std::strerror(errno));
+      return false;
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes  = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      g_log->error("io_uring: can't map submission entries: {}", std::strerror(errno));
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    auto base = static_cast<char*>(rings_);
+    sq_head_  = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sq_tail_  = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sq_mask_  = reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sq_flags_ = reinterpret_cast<unsigned*>(base + params.sq_off.flags);
+    cq_head_  = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cq_tail_  = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cq_mask_  = reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes_     = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+    // entries are used in order, so index array maps each slot to itself
+    auto array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; i++) {
+      array[i] = i;
+    }
+    sqe_tail_ = *sq_tail_;
+    return true;
+  }
+
+  bool register_buffer_ring(io_uring_buf_ring* ring, unsigned entries, uint16_t group) {
+    io_uring_buf_reg reg{};
+    reg.ring_addr    = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid         = group;
+    if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+      g_log->error("io_uring: can't register buffer ring: {}", std::strerror(errno));
+      return false;
+    }
+    return true;
+  }
+
+  /** @brief makes sure that next count entries are submitted together, e.g. linked ones. */
+  void reserve(unsigned count) {
+    if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) + count > sq_entries_) {
+      submit();
+    }
+  }
+
+  /** @brief zeroed entry, nullptr if queue is full and kernel doesn't take it. */
+  io_uring_sqe* get_sqe() {
+    reserve(1);
+    if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+      g_log->error("io_uring: submission queue is full");
+      return nullptr;
+    }
+    auto sqe = &sqes_[sqe_tail_ & *sq_mask_];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe_tail_++;
+    return sqe;
+  }
+
+  void submit() {
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    auto     pending = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    unsigned flags   = overflown() ? IORING_ENTER_GETEVENTS : 0; // flushes completions kernel kept aside
+    if (pending == 0 && flags == 0) {
+      return;
+    }
+    while (::syscall(__NR_io_uring_enter, fd_, pending, 0, flags, nullptr, 0) < 0) {
+      if (errno != EINTR) {
+        g_log->error("io_uring: submit error: {}", std::strerror(errno));
+        return;
+      }
+    }
+  }
+
+  /** @brief submits queued entries and blocks until there is completion. returns false on error. */
+  bool wait() {
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    auto pending = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    while (::syscall(__NR_io_uring_enter, fd_, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) {
+      if (errno != EINTR) {
+        g_log->error("io_uring: wait error: {}", std::strerror(errno));
+        return false;
+      }
+      pending = 0;
+    }
+    return true;
+  }
+
+  /** @brief calls on_cqe for each completion, entry is released before call. */
+  template <typename TCallback>
+  void reap(TCallback&& on_cqe) {
+    for (;;) {
+      auto head = *cq_head_;
+      if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        if (!overflown()) {
+          return;
+        }
+        ::syscall(__NR_io_uring_enter, fd_, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+          return;
+        }
+      }
+      auto cqe = cqes_[head & *cq_mask_];
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      on_cqe(cqe);
+    }
+  }
+
+private:
+  [[nodiscard]] bool overflown() const {
+    return (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) != 0;
+  }
+};
+
+//---------------------------------------------------------------
+// state of accepted socket, shared by server and by writer which could outlive it.
+// requests of connection point to it, so server keeps it until all of them complete.
+struct http::UringConnection {
+  int                      fd{ -1 };
+  bool                     tcp{ true };
+  ITcpReader*              reader{ nullptr };
+  size_t                   operations{ 0 }; // submitted and not completed yet
+  bool                     recv_armed{ false };
+  bool                     closing{ false };          // nothing is read and written anymore
+  bool                     close_after_send{ false }; // writer is done, close is linked to last send
+  bool                     close_submitted{ false };
+  bool                     closed{ false };
+  bool                     dirty{ false };
+  bool                     corked{ false };
+  bool                     uncork{ false }; // after queued data is sent
+  std::vector<std::string> segments{};      // written during current loop iteration
+  size_t                   segments_size{ 0 };
+  std::vector<std::string> sending{}; // in flight, one sendmsg at a time
+  size_t                   sending_size{ 0 };
+  std::vector<iovec>       iov{};
+  msghdr                   message{};
+  std::function<void()>    drain_callback{};
+
+  void wake_drain() {
+    if (drain_callback) {
+      auto callback  = std::move(drain_callback);
+      drain_callback = nullptr;
+      callback();
+    }
+  }
+
+  void set_cork(bool enable) {
+    if (corked == enable || closing || !tcp) {
+      return;
+    }
+    corked    = enable;
+    int value = enable ? 1 : 0;
+    if (::setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) != 0) {
+      g_log->debug("uring_writer: cork error: {}", std::strerror(errno));
+    }
+  }
+};
+
+//---------------------------------------------------------------
+
+struct http::UringWriter : public ITcpWriter {
+  UringServer*                     server;
+  std::shared_ptr<UringConnection> connection;
+
+  UringWriter(UringServer* server, std::shared_ptr<UringConnection> connection)
+      : server{ server }
+      , connection{ std::move(connection) } {}
+
+  ~UringWriter() override {
+    g_log->debug("~UringWriter");
+    connection->drain_callback = nullptr;
+  }
+
+  void done() override {
+    write_data();
+    if (connection->closing) {
+      return;
+    }
+    connection->closing          = true;
+    connection->close_after_send = true;
+    if (connection->recv_armed) {
+      // socket stays referenced by multishot recv, so it's cancelled before close
+      if (auto sqe = server->ring_->get_sqe()) {
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->addr      = make_user_data(connection.get(), Operation::Recv);
+        sqe->user_data = make_user_data(nullptr, Operation::Cancel);
+      }
+    }
+    server->mark_dirty(connection.get());
+    g_log->debug("uring_writer: done");
+  }
+
+  void flush() override {
+    write_data();
+    if (!connection->segments.empty()) {
+      server->mark_dirty(connection.get());
+    }
+  }
+
+  size_t pending() const override { return connection->segments_size + connection->sending_size; }
+  bool   closed() const override { return connection->closing; }
+  int    fd() const override { return connection->closing ? -1 : connection->fd; }
+
+  std::string peer() const override {
+    sockaddr_storage addr{};
+    socklen_t        length = sizeof(addr);
+    if (connection->closing || !connection->tcp || ::getpeername(connection->fd, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+      return {};
+    }
+    char ip[INET6_ADDRSTRLEN]{};
+    if (addr.ss_family == AF_INET6) {
+      ::inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(&addr)->sin6_addr, ip, sizeof(ip));
+    } else {
+      ::inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&addr)->sin_addr, ip, sizeof(ip));
+    }
+    return ip;
+  }
+
+  void abort() override { server->close_connection(connection.get()); }
+
+  void cork(bool enable) override {
+    if (!enable && pending() != 0) {
+      connection->uncork = true;
+      return;
+    }
+    connection->uncork = false;
+    connection->set_cork(enable);
+  }
+
+  void on_drain(std::function<void()> cb) override {
+    if (pending() == 0 || closed()) {
+      cb();
+    } else {
+      connection->drain_callback = std::move(cb);
+    }
+  }
+
+private:
+  void write_data() {
+    auto str = std::move(data).str();
+    data.str({});
+    if (str.empty() || connection->closing) {
+      return;
+    }
+    connection->segments_size += str.size();
+    connection->segments.push_back(std::move(str));
+  }
+};
+
+//---------------------------------------------------------------
+
+std::unique_ptr<UringServer> UringServer::create(std::unique_ptr<ITcpReaderFactory> reader_factory) {
+  std::unique_ptr<UringServer> server{ new UringServer(std::move(reader_factory)) };
+  if (!server->init()) {
+    return nullptr;
+  }
+  return server;
+}
+
+UringServer::UringServer(std::unique_ptr<ITcpReaderFactory> reader_factory)
+    : ring_{ std::make_unique<UringRing>() }
+    , reader_factory_{ std::move(reader_factory) } {}
+
+UringServer::~UringServer() {
+  if (poll_) {
+    poll_->close();
+  }
+  if (prepare_) {
+    prepare_->close();
+  }
+  for (auto& listener : listeners_) {
+    if (listener->fd >= 0) {
+      ::close(listener->fd);
+    }
+  }
+  if (buffer_ring_) {
+    ::munmap(buffer_ring_, buffers_count * sizeof(io_uring_buf));
+  }
+}
+
+bool UringServer::init() {
+  if (!ring_->init(ring_entries)) {
+    return false;
+  }
+
+  // receives pick buffers from this ring, each buffer is put back after reader has seen it
+  auto ring = ::mmap(nullptr, buffers_count * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    g_log->error("io_uring: can't allocate buffer ring: {}", std::strerror(errno));
+    return false;
+  }
+  buffer_ring_ = static_cast<io_uring_buf_ring*>(ring);
+  if (!ring_->register_buffer_ring(buffer_ring_, buffers_count, buffer_group)) {
+    return false;
+  }
+  buffers_ = std::make_unique_for_overwrite<std::byte[]>(size_t{ buffers_count } * buffer_size);
+  for (unsigned id = 0; id < buffers_count; id++) {
+    recycle_buffer(static_cast<uint16_t>(id));
+  }
+
+  if (!probe_recv_multishot()) {
+    g_log->error("io_uring: kernel doesn't support multishot recv");
+    return false;
+  }
+
+  auto loop = uvw::Loop::getDefault();
+  poll_     = loop->resource<uvw::PollHandle>(ring_->fd());
+  poll_->on<uvw::PollEvent>([this](const uvw::PollEvent&, uvw::PollHandle&) {
+    ring_->reap([this](const io_uring_cqe& cqe) { on_completion(cqe); });
+  });
+  poll_->start(uvw::PollHandle::Event::READABLE);
+
+  // everything written during loop iteration is sent here, with one syscall for all connections
+  prepare_ = loop->resource<uvw::PrepareHandle>();
+  prepare_->on<uvw::PrepareEvent>([this](const uvw::PrepareEvent&, uvw::PrepareHandle&) {
+    auto dirty = std::move(dirty_);
+    dirty_.clear();
+    for (auto connection : dirty) {
+      connection->dirty = false;
+      send(connection);
+    }
+    ring_->submit();
+  });
+  prepare_->start();
+  prepare_->unreference();
+
+  update_reference();
+  g_log->info("io_uring network backend is used");
+  return true;
+}
+
+// kernel 5.19 has multishot accept and buffer rings, but fails multishot recv with EINVAL.
+// byte and end of stream are received from socket pair: supported recv reports more completions after byte.
+bool UringServer::probe_recv_multishot() {
+  int pair[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+    g_log->error("io_uring: socketpair error: {}", std::strerror(errno));
+    return false;
+  }
+  char byte{ 0 };
+  ::send(pair[1], &byte, 1, MSG_NOSIGNAL);
+  ::shutdown(pair[1], SHUT_WR);
+
+  bool supported{ false };
+  if (auto sqe = ring_->get_sqe()) {
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = pair[0];
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffer_group;
+    sqe->user_data = make_user_data(nullptr, Operation::Cancel);
+
+    for (bool done = false; !done;) {
+      if (!ring_->wait()) {
+        break;
+      }
+      ring_->reap([&](const io_uring_cqe& cqe) {
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+          recycle_buffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        if (cqe.flags & IORING_CQE_F_MORE) {
+          supported = true;
+        } else {
+          done = true;
+        }
+      });
+    }
+  }
+
+  ::close(pair[0]);
+  ::close(pair[1]);
+  return supported;
+}
+
+//---------------------------------------------------------------
+
+void UringServer::listen(const char* addr, int port) {
+  sockaddr_storage storage{};
+  socklen_t        length{ 0 };
+  auto             v4 = reinterpret_cast<sockaddr_in*>(&storage);
+  auto             v6 = reinterpret_cast<sockaddr_in6*>(&storage);
+  if (::inet_pton(AF_INET, addr, &v4->sin_addr) == 1) {
+    v4->sin_family = AF_INET;
+    v4->sin_port   = htons(static_cast<uint16_t>(port));
+    length         = sizeof(sockaddr_in);
+  } else if (::inet_pton(AF_INET6, addr, &v6->sin6_addr) == 1) {
+    v6->sin6_family = AF_INET6;
+    v6->sin6_port   = htons(static_cast<uint16_t>(port));
+    length          = sizeof(sockaddr_in6);
+  } else {
+    g_log->error("io_uring: invalid address {}", addr);
+    return;
+  }
+
+  int fd = ::socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    g_log->error("io_uring: socket error: {}", std::strerror(errno));
+    return;
+  }
+  int reuse = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&storage), length) != 0) {
+    g_log->error("io_uring: bind error on {}:{}: {}", addr, port, std::strerror(errno));
+    ::close(fd);
+    return;
+  }
+  listen(fd);
+}
+
+void UringServer::listen(int fd) {
+  if (::listen(fd, SOMAXCONN) != 0) {
+    g_log->error("io_uring: listen error: {}", std::strerror(errno));
+    ::close(fd);
+    return;
+  }
+  start_listener(fd);
+}
+
+void UringServer::listen_unix(const std::string& path) {
+  sockaddr_un addr{};
+  auto        abstract = !path.empty() && path.front() == '@';
+  if (path.size() + 1 > sizeof(addr.sun_path)) {
+    g_log->error("io_uring: unix socket name is too long: {}", path);
+    return;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.data(), path.size());
+  if (abstract) {
+    addr.sun_path[0] = '\0'; // leading zero byte selects abstract namespace
+  } else {
+    remove_stale_unix_socket(path);
+  }
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    g_log->error("io_uring: unix socket error: {}", std::strerror(errno));
+    return;
+  }
+  auto length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + (abstract ? 0 : 1));
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), length) != 0) {
+    g_log->error("io_uring: unix socket bind error on {}: {}", path, std::strerror(errno));
+    ::close(fd);
+    return;
+  }
+  listen(fd);
+}
+
+int UringServer::fd() const {
+  for (auto& listener : listeners_) {
+    if (listener->tcp && !listener->closing) {
+      return listener->fd;
+    }
+  }
+  return -1;
+}
+
+void UringServer::close() {
+  for (auto& listener : listeners_) {
+    if (listener->closing) {
+      continue;
+    }
+    listener->closing = true;
+    if (!listener->armed) {
+      ::close(listener->fd);
+      listener->fd = -1;
+    } else if (auto sqe = ring_->get_sqe()) {
+      // socket is closed when accept is completed
+      sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+      sqe->addr      = make_user_data(listener.get(), Operation::Accept);
+      sqe->user_data = make_user_data(nullptr, Operation::Cancel);
+    }
+  }
+  update_reference();
+}
+
+//---------------------------------------------------------------
+
+void UringServer::start_listener(int fd) {
+  sockaddr_storage addr{};
+  socklen_t        length = sizeof(addr);
+  ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+
+  listeners_.push_back(std::make_unique<Listener>(Listener{ .fd = fd, .tcp = addr.ss_family != AF_UNIX }));
+  if (max_connections_ == 0 || connections_.size() < max_connections_) {
+    arm_accept(listeners_.back().get());
+  } else {
+    paused_ = true;
+  }
+  update_reference();
+}
+
+void UringServer::arm_accept(Listener* listener) {
+  auto sqe = ring_->get_sqe();
+  if (!sqe) {
+    return;
+  }
+  sqe->opcode       = IORING_OP_ACCEPT;
+  sqe->fd           = listener->fd;
+  sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC; // file sender relies on non blocking socket
+  sqe->user_data    = make_user_data(listener, Operation::Accept);
+  listener->armed   = true;
+}
+
+void UringServer::arm_accepts() {
+  if (paused_) {
+    return;
+  }
+  accept_retry_.cancel();
+  for (auto& listener : listeners_) {
+    if (!listener->armed && !listener->closing) {
+      arm_accept(listener.get());
+    }
+  }
+}
+
+void UringServer::arm_recv(UringConnection* connection) {
+  auto sqe = ring_->get_sqe();
+  if (!sqe) {
+    return;
+  }
+  sqe->opcode     = IORING_OP_RECV;
+  sqe->fd         = connection->fd;
+  sqe->ioprio     = IORING_RECV_MULTISHOT;
+  sqe->flags      = IOSQE_BUFFER_SELECT;
+  sqe->buf_group  = buffer_group;
+  sqe->user_data  = make_user_data(connection, Operation::Recv);
+  connection->operations++;
+  connection->recv_armed = true;
+}
+
+void UringServer::accept_connection(Listener* listener, int fd) {
+  if (listener->tcp && no_delay_) {
+    int value = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+  }
+
+  auto connection = std::make_shared<UringConnection>();
+  connection->fd  = fd;
+  connection->tcp = listener->tcp;
+  connections_.emplace(connection.get(), connection);
+  connection->reader = reader_factory_->create(new UringWriter(this, connection));
+  arm_recv(connection.get());
+  g_log->debug("uring_server: accept");
+
+  // accepts are cancelled, next one is armed when connection is finished
+  if (max_connections_ != 0 && connections_.size() >= max_connections_ && !paused_) {
+    g_log->debug("uring_server: connection limit {} reached, accept paused", max_connections_);
+    paused_ = true;
+    for (auto& other : listeners_) {
+      if (other->armed && !other->closing) {
+        if (auto sqe = ring_->get_sqe()) {
+          sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+          sqe->addr      = make_user_data(other.get(), Operation::Accept);
+          sqe->user_data = make_user_data(nullptr, Operation::Cancel);
+        }
+      }
+    }
+  }
+  update_reference();
+}
+
+void UringServer::send(UringConnection* connection) {
+  if (connection->close_submitted || !connection->sending.empty()) {
+    return; // it's sent again when in flight request is completed
+  }
+  if (connection->segments.empty()) {
+    if (connection->close_after_send) {
+      submit_close(connection);
+    }
+    return;
+  }
+
+  auto count = std::min(connection->segments.size(), max_iov);
+  if (count == connection->segments.size()) {
+    connection->sending = std::move(connection->segments);
+    connection->segments.clear();
+  } else {
+    auto end = connection->segments.begin() + static_cast<ptrdiff_t>(count);
+    connection->sending.assign(std::make_move_iterator(connection->segments.begin()), std::make_move_iterator(end));
+    connection->segments.erase(connection->segments.begin(), end);
+  }
+
+  connection->iov.clear();
+  connection->sending_size = 0;
+  for (auto& segment : connection->sending) {
+    connection->iov.push_back(iovec{ segment.data(), segment.size() });
+    connection->sending_size += segment.size();
+  }
+  connection->segments_size -= connection->sending_size;
+  connection->message            = {};
+  connection->message.msg_iov    = connection->iov.data();
+  connection->message.msg_iovlen = connection->iov.size();
+
+  bool last = connection->close_after_send && connection->segments.empty();
+  ring_->reserve(last ? 2 : 1); // linked requests should be submitted together
+  auto sqe = ring_->get_sqe();
+  if (!sqe) {
+    return;
+  }
+  sqe->opcode    = IORING_OP_SENDMSG;
+  sqe->fd        = connection->fd;
+  sqe->addr      = reinterpret_cast<uint64_t>(&connection->message);
+  sqe->len       = 1;
+  sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL; // kernel retries partial sends itself
+  sqe->user_data = make_user_data(connection, Operation::Send);
+  connection->operations++;
+  g_log->debug("uring_writer: write {} segments", connection->iov.size());
+
+  if (last) {
+    sqe->flags |= IOSQE_IO_LINK;
+    submit_close(connection);
+  }
+}
+
+void UringServer::finish_send(UringConnection* connection, int result) {
+  connection->operations--;
+  if (result < 0) {
+    if (result != -ECANCELED) {
+      g_log->debug("uring_writer: write error: {}", std::strerror(-result));
+    }
+    connection->sending.clear();
+    connection->sending_size = 0;
+    close_connection(connection);
+    return;
+  }
+
+  // short send breaks link to close, rest of data goes first in next send
+  auto sent = static_cast<size_t>(result);
+  if (sent < connection->sending_size) {
+    size_t skip = 0;
+    while (sent >= connection->sending[skip].size()) {
+      sent -= connection->sending[skip++].size();
+    }
+    connection->sending[skip].erase(0, sent);
+    connection->segments.insert(connection->segments.begin(),
+                                std::make_move_iterator(connection->sending.begin() + static_cast<ptrdiff_t>(skip)),
+                                std::make_move_iterator(connection->sending.end()));
+    connection->segments_size += connection->sending_size - static_cast<size_t>(result);
+  }
+  connection->sending.clear();
+  connection->sending_size = 0;
+
+  if (!connection->segments.empty() || (connection->close_after_send && !connection->close_submitted)) {
+    mark_dirty(connection);
+  } else if (!connection->closing) {
+    if (connection->uncork) {
+      connection->uncork = false;
+      connection->set_cork(false);
+    }
+    connection->wake_drain();
+  }
+}
+
+void UringServer::close_connection(UringConnection* connection) {
+  connection->closing          = true;
+  connection->close_after_send = false;
+  connection->segments.clear();
+  connection->segments_size = 0;
+  connection->wake_drain();
+  if (connection->close_submitted) {
+    return;
+  }
+
+  // all requests of socket are cancelled, close is done after them
+  if (auto sqe = ring_->get_sqe()) {
+    sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+    sqe->fd           = connection->fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data    = make_user_data(nullptr, Operation::Cancel);
+  }
+  submit_close(connection);
+}
+
+void UringServer::submit_close(UringConnection* connection) {
+  auto sqe = ring_->get_sqe();
+  if (!sqe) {
+    return;
+  }
+  sqe->opcode    = IORING_OP_CLOSE;
+  sqe->fd        = connection->fd;
+  sqe->user_data = make_user_data(connection, Operation::Close);
+  connection->operations++;
+  connection->close_submitted = true;
+}
+
+void UringServer::finish_connection(UringConnection* connection) {
+  g_log->debug("uring_server: connection closed");
+  connection->wake_drain();
+  if (connection->dirty) {
+    std::erase(dirty_, connection);
+  }
+  reader_factory_->destroy(connection->reader);
+  connection->reader = nullptr;
+  connections_.erase(connection); // writer could still hold it
+
+  if (paused_ && (max_connections_ == 0 || connections_.size() < max_connections_)) {
+    paused_ = false;
+    arm_accepts();
+  }
+  update_reference();
+}
+
+void UringServer::mark_dirty(UringConnection* connection) {
+  if (!connection->dirty) {
+    connection->dirty = true;
+    dirty_.push_back(connection);
+  }
+}
+
+void UringServer::recycle_buffer(uint16_t id) {
+  // only this thread produces buffers, kernel sees new tail after release store
+  // entries are indexed from ring start: in c++ uapi header places flexible bufs member after padding
+  auto  tail   = buffer_ring_->tail;
+  auto& buffer = reinterpret_cast<io_uring_buf*>(buffer_ring_)[tail & (buffers_count - 1)];
+  buffer.addr  = reinterpret_cast<uint64_t>(buffers_.get() + size_t{ id } * buffer_size);
+  buffer.len   = buffer_size;
+  buffer.bid   = id;
+  __atomic_store_n(&buffer_ring_->tail, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+}
+
+void UringServer::update_reference() {
+  // same as libuv handles: loop runs while server listens or has connections
+  bool listening = std::any_of(listeners_.begin(), listeners_.end(), [](auto& listener) { return !listener->closing; });
+  if (listening || !connections_.empty()) {
+    poll_->reference();
+  } else {
+    poll_->unreference();
+  }
+}
+
+//---------------------------------------------------------------
+
+void UringServer::on_completion(const io_uring_cqe& cqe) {
+  auto target = reinterpret_cast<void*>(cqe.user_data & ~operation_mask);
+  switch (static_cast<Operation>(cqe.user_data & operation_mask)) {
+    case Operation::Accept:
+      on_accept(static_cast<Listener*>(target), cqe);
+      break;
+    case Operation::Recv:
+      on_recv(static_cast<UringConnection*>(target), cqe);
+      break;
+    case Operation::Send: {
+      auto connection = static_cast<UringConnection*>(target);
+      finish_send(connection, cqe.res);
+      if (connection->closed && connection->operations == 0) {
+        finish_connection(connection);
+      }
+      break;
+    }
+    case Operation::Close:
+      on_close(static_cast<UringConnection*>(target), cqe);
+      break;
+    case Operation::Cancel:
+      break;
+  }
+}
+
+void UringServer::on_accept(Listener* listener, const io_uring_cqe& cqe) {
+  bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+  if (!more) {
+    listener->armed = false;
+  }
+
+  if (cqe.res >= 0) {
+    if (listener->closing) {
+      ::close(cqe.res);
+    } else {
+      accept_connection(listener, cqe.res);
+    }
+  } else if (cqe.res != -ECANCELED) {
+    g_log->error("io_uring: accept error: {}", std::strerror(-cqe.res));
+  }
+
+  if (more) {
+    return;
+  }
+  if (!listener->closing) {
+    switch (-cqe.res) {
+      case EMFILE:
+      case ENFILE:
+      case ENOBUFS:
+      case ENOMEM:
+        // pending connection is still there, so accept would fail again right away
+        if (!accept_retry_.armed()) {
+          accept_retry_.start(accept_backoff);
+        }
+        return;
+      case EINVAL:
+      case EBADF:
+      case ENOTSOCK:
+      case EOPNOTSUPP:
+        g_log->error("io_uring: listener can't accept, it's stopped");
+        listener->closing = true;
+        update_reference();
+        break;
+      default:
+        if (!paused_) {
+          arm_accept(listener);
+        }
+        return;
+    }
+  }
+  if (listener->fd >= 0) {
+    ::close(listener->fd);
+    listener->fd = -1;
+  }
+}
+
+void UringServer::on_recv(UringConnection* connection, const io_uring_cqe& cqe) {
+  bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+  if (!more) {
+    connection->operations--;
+    connection->recv_armed = false;
+  }
+
+  if (cqe.flags & IORING_CQE_F_BUFFER) {
+    auto id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    if (cqe.res > 0 && !connection->closing) {
+      g_log->debug("uring_server: data event");
+      connection->reader->read(reinterpret_cast<char*>(buffers_.get() + size_t{ id } * buffer_size), static_cast<size_t>(cqe.res));
+    }
+    recycle_buffer(id); // reader copies what it keeps
+  }
+
+  if (cqe.res == 0) {
+    g_log->debug("uring_server: end event");
+    close_connection(connection);
+  } else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+    g_log->debug("uring_server: read error: {}", std::strerror(-cqe.res));
+    close_connection(connection);
+  } else if (!more && !connection->closing) {
+    arm_recv(connection); // buffers were exhausted, they are back by now
+  }
+
+  if (!more && connection->closed && connection->operations == 0) {
+    finish_connection(connection);
+  }
+}
+
+void UringServer::on_close(UringConnection* connection, const io_uring_cqe& cqe) {
+  connection->operations--;
+  connection->close_submitted = false;
+  if (cqe.res == -ECANCELED) {
+    // link is broken by failed or short send: rest is sent first, or socket is just closed
+    if (connection->segments.empty()) {
+      submit_close(connection);
+    } else {
+      mark_dirty(connection);
+    }
+    return;
+  }
+  if (cqe.res < 0) {
+    g_log->debug("uring_server: close error: {}", std::strerror(-cqe.res));
+  }
+
+  connection->closed          = true;
+  connection->close_submitted = true; // never again
+  if (connection->operations == 0) {
+    finish_connection(connection);
+  }
+}
+
+//---------------------------------------------------------------
+
+#endif
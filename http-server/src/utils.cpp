@@ -1,17 +1,11 @@
 #include "http-server/utils.hpp"
 #include "http-server/log.hpp"
+#include "http-server/scheduler.hpp"
 
 using namespace http;
 
 void http::next_tick(std::function<void()> func) {
-  using namespace std::chrono_literals;
-  auto timer = uvw::Loop::getDefault()->resource<uvw::TimerHandle>();
-  timer->init();
-  timer->on<uvw::TimerEvent>([func = std::move(func)](const uvw::TimerEvent&, uvw::TimerHandle& timer) {
-    func();
-    timer.close();
-  });
-  timer->start(0ms, 0ms);
+  Scheduler::local().post(std::move(func));
 }
 
 int http::run_main_loop() {
@@ -30,6 +24,34 @@ std::string http::replace_all(std::string str, std::string_view from, std::strin
   return str;
 }
 
+bool http::iequals(std::string_view a, std::string_view b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char l, char r) {
+           return std::tolower(static_cast<unsigned char>(l)) == std::tolower(static_cast<unsigned char>(r));
+         });
+}
+
+std::optional<std::string> http::url_decode(std::string_view str) {
+  std::string result;
+  result.reserve(str.size());
+  for (size_t i = 0; i < str.size(); i++) {
+    if (str[i] != '%') {
+      result += str[i];
+      continue;
+    }
+    uint8_t value{ 0 };
+    if (i + 2 >= str.size()) {
+      return std::nullopt;
+    }
+    auto [end, ec] = std::from_chars(str.data() + i + 1, str.data() + i + 3, value, 16);
+    if (ec != std::errc{} || end != str.data() + i + 3) {
+      return std::nullopt;
+    }
+    result += static_cast<char>(value);
+    i += 2;
+  }
+  return result;
+}
+
 std::function<void(const std::exception_ptr&)> http::unwrap_exception_ptr(
     std::function<void(const std::exception&)> on_ex) {
   return [on_ex = std::move(on_ex)](const std::exception_ptr& ptr) {